@@ -29,6 +29,12 @@ static const Rule rules[] = {
 static const float mfact     = 0.55 ; /* Factor of master area size [0.05..0.95]. */
 static const int nmaster     = 1 ; /* Number of clients in master area. */
 static const int resizehints = 1 ; /* 1 means respect size hints in tiled resizals. */
+static const uint stackpage = 8 ; /* Stack clients shown at a time by tiled layouts, 0 means all. */
+static const int livedrag = 1 ; /* 1 means clients follow the pointer while dragged. */
+static const int framerate = 60 ; /* Geometry updates per second of live drags and scrolling, the display refresh rate. */
+static const int synctimeout = 100 ; /* Ms to wait for a client to draw its new size before resizing it again. */
+static const int smoothscroll = 1 ; /* 1 means the canvas scrolls over several frames. */
+static const int scrollease = 4 ; /* Each frame scrolls 1/scrollease of the distance left. */
 
 /* Layouts on the tags you get when start WM. */
 static const SetupLayout setup_layouts[9] = {
@@ -46,12 +52,15 @@ static const SetupLayout setup_layouts[9] = {
 
 static const Layout layouts[] = {
 	/* Standard is ALWAYS floating. */
-	/* Symbol, arrange function. */
-	[LayoutFloating] = { "[F]", floating}, /* Floating layout. */
-	[LayoutTile] = { "[T]", tile }, /* Tiled layout. */
-	[LayoutMonocle] = { "[M]", monocle }, /* Maximized layout. */
-	[LayoutSplit] = {"[S]", split},  /* Split layout. */
-	[LayoutRootwin] = {"[R]", rootwin},
+	/* Symbol, arrange function, plan function. */
+	[LayoutFloating] = { "[F]", floating, NULL }, /* Floating layout. */
+	[LayoutTile] = { "[T]", arrangeplan, tile }, /* Tiled layout. */
+	[LayoutMonocle] = { "[M]", arrangeplan, monocle }, /* Maximized layout. */
+	[LayoutSplit] = {"[S]", arrangeplan, split},  /* Split layout. */
+	[LayoutRootwin] = {"[R]", arrangeplan, rootwin},
+	[LayoutGrid] = {"[G]", arrangeplan, grid}, /* Square grid. */
+	[LayoutCentered] = {"[C]", arrangeplan, centeredmaster}, /* Master in the middle. */
+	[LayoutFibonacci] = {"[D]", arrangeplan, fibonacci}, /* Dwindling halves. */
 } ;
 
 /* Key definitions. */
@@ -62,62 +71,58 @@ static const Layout layouts[] = {
 	{ MODKEY|ShiftMask, KEY, tag, {.ui = 1 << TAG} }, /* Move current window to this tag. */\
 	{ MODKEY|ControlMask|ShiftMask, KEY,  toggletag, {.ui = 1 << TAG} } /* Link current wiwond to this tag. */
 
+/* Spawn through a small process forked at start instead of forking the WM. */
+static const int uselauncher = 1 ;
+
 static char menumon[] = "0" ;
 /* Easier CMD assigning. $1 in scripts is current monitor. */
 #define SHCMD(cmd) { "rc", "-l", "-c", cmd, menumon, NULL }/*)*/
 
-#define XRESOURCES "$home/lib/xresources"
-#define XRESOURCES_MERGE "test -r " XRESOURCES " && xrdb -merge " XRESOURCES
-
 #define XMODMAP "$home/lib/xmodmap"
 #define XMODMAP_MERGE " test -r " XMODMAP " && xmodmap "XMODMAP
 /* Setting of window manager name which let you change the title in right up corner. */
 #define SETWMNAME(str) "out = `{echo -n "str"} ; xsetroot -name $\"out"
 
 /* Keyboard. */
-#define SET_KB_LT "setxkbmap -model pc105 -keycodes evdev"
-/* It's made to escape using Compose key in games and stuff. */
-#define CLEAR_KB_LT SET_KB_LT " -option"
-
 /* Native map for your language. */
 #define NATIVE_KB_MAP "ru"
 
-/* Option. */
-#define KB_OPTION "grp:alt_space_toggle,caps:escape,ctrl:swap_lalt_lctl,ctrl:swap_ralt_rctl"
-#define KB_DVORAK_COMPOSE_OPTION "compose:ralt"
-
-/* Dvorak. */
-#define DVORAK_KB_LT "-layout us," NATIVE_KB_MAP " -variant dvorak, -option " KB_OPTION "," KB_DVORAK_COMPOSE_OPTION
-#define SET_DVORAK_KB_LT SET_KB_LT " " DVORAK_KB_LT
-
-/* Programmer dvorak. */
-#define DVP_KB_LT "-layout us," NATIVE_KB_MAP" -variant dvp, -option "KB_OPTION
-#define SET_DVP_KB_LT SET_KB_LT " " DVP_KB_LT
-
-/* Qwerty. */
-#define QWERTY_KB_LT "-layout us," NATIVE_KB_MAP " -option "KB_OPTION
-#define SET_QWERTY_KB_LT CLEAR_KB_LT ";" SET_KB_LT " " QWERTY_KB_LT
-
-/* Native layout. */
-#define NATIVE_KB_LT "-layout " NATIVE_KB_MAP ",us -variant ,dvorak -option " KB_OPTION
-#define SET_NATIVE_KB_LT SET_KB_LT " " NATIVE_KB_LT
+/* Keyboard map loaded once by "startup" as XKB components, which
+* "setxkbmap -print" shows for any "setxkbmap" options. Options here are
+* "caps:escape,ctrl:swap_lalt_lctl,ctrl:swap_ralt_rctl"
+* and "compose:ralt". Each layout is an XKB group, at most four of them.
+* Alt+Space is a binding below rather than "grp:alt_space_toggle", which
+* would cycle all four groups. */
+#define XKB_OPTION_SYMBOLS "+inet(evdev)+capslock(escape)+ctrl(swap_lalt_lctl)+ctrl(swap_ralt_rctl)+compose(ralt)"
+static const XkbComponentNamesRec xkbnames = {
+	.keycodes = "evdev",
+	.types = "complete",
+	.compat = "complete",
+	.symbols = "pc+us(dvorak)+us(dvp):2+us:3+" NATIVE_KB_MAP ":4" XKB_OPTION_SYMBOLS,
+	.geometry = "pc(pc105)",
+} ;
 
-/* Keyboard options. */
-#define KB_REPEAT_RATE "60"
-#define KB_REPEAT_DELAY "300"
-#define SET_KB_OPTIONS "xset r rate " KB_REPEAT_DELAY " " KB_REPEAT_RATE
+/* Layouts for "setkeymap", groups of the map above. Locking a group is a
+* single request, the map is not compiled again. */
+enum { KeymapDvorak, KeymapDvp, KeymapQwerty, KeymapNative } ;
+static const Keymap keymaps[] = {
+	/* Status name, group. */
+	[KeymapDvorak] = { "dvorak", XkbGroup1Index },
+	[KeymapDvp] = { "dvp", XkbGroup2Index },
+	[KeymapQwerty] = { "qwerty", XkbGroup3Index },
+	[KeymapNative] = { "native", XkbGroup4Index },
+} ;
 
-/* Xsetroot. */
-#define XSETROOT "xsetroot"
-#define XSETROOT_SOLID_GRAY XSETROOT " -solid '#333333'"
+/* Start up, done by "setup" on the WM connection. */
+static const char startstatus[] = "Hello, master" ; /* User name is appended. */
+static const Keymap *startkeymap = &keymaps[KeymapDvorak] ;
+static const uint repeatdelay = 300 ; /* Milliseconds before keys start to repeat. */
+static const uint repeatrate = 60 ; /* Repeats per second. */
+static const char xresources[] = "lib/xresources" ; /* Merged like "xrdb -merge", relative to $HOME. */
+static const char rootcolor[] = "#333333" ;
 
-/* It is called on "xwm" start. */
-static char *rccmd[] = SHCMD( SETWMNAME("Hello, master `{whoami}") ";" \
-	SET_DVORAK_KB_LT ";" \
-	SET_KB_OPTIONS ";" \
-	XRESOURCES_MERGE ";"\
-	XSETROOT_SOLID_GRAY ";"
-	"if( which VBoxClient-all ) VBoxClient-all & ;") ;
+/* It is called on "xwm" start for everything else. */
+static char *rccmd[] = SHCMD("if( which VBoxClient-all ) VBoxClient-all & ;") ;
 
 /* Spawners. */
 static char *runcmd[] = SHCMD(
@@ -141,12 +146,6 @@ static char *termcmd[] = SHCMD("xmux -txmux $PERSONAL_SHELL") ; /* Fancy termina
 static char *stermcmd[] = SHCMD("xtrm $PERSONAL_SHELL") ; /* Simpler terminal to run. */
 static char *plumbcmd[] = SHCMD("url=`{eval echo `{xsel}} ; exec  xplumb $\"url") ;
 
-/* Keyboard layouts. */
-static const char *dvorakkbdcmd[] = SHCMD(SETWMNAME("dvorak") ";" SET_DVORAK_KB_LT ";" );
-static const char *dvpkbdcmd[] = SHCMD(SETWMNAME("dvp") ";" SET_DVP_KB_LT ";" ) ;
-static const char *natkbdcmd[] = SHCMD(SETWMNAME("native")";" SET_NATIVE_KB_LT ";" ) ;
-static const char *qwertykbdcmd[] = SHCMD(SETWMNAME("qwerty")";" SET_QWERTY_KB_LT ";" ) ;
-
 static Key keys[] = {
 	/* Modifier, key, function, argument. */
 	/* Program spawners. */
@@ -157,10 +156,11 @@ static Key keys[] = {
 	{ MODKEY|ShiftMask, XK_p, spawn, {.v = plumbcmd} }, /* Plumber. */
 
 	/* Clients stuff and input. (The most often used) */
-	{ MODKEY, XK_a, spawn, {.v = qwertykbdcmd} }, /* Qwerty. */
-	{ MODKEY, XK_Tab, spawn, {.v = dvorakkbdcmd} }, /* Dvorak. */
-	{ MODKEY, XK_BackSpace, spawn, {.v = natkbdcmd} }, /* Alternative. */
-	{ MODKEY, XK_Return, spawn, {.v = dvpkbdcmd} }, /* Dvorak programmer. */
+	{ MODKEY, XK_a, setkeymap, {.v = &keymaps[KeymapQwerty]} }, /* Qwerty. */
+	{ MODKEY, XK_Tab, setkeymap, {.v = &keymaps[KeymapDvorak]} }, /* Dvorak. */
+	{ MODKEY, XK_BackSpace, setkeymap, {.v = &keymaps[KeymapNative]} }, /* Alternative. */
+	{ MODKEY, XK_Return, setkeymap, {.v = &keymaps[KeymapDvp]} }, /* Dvorak programmer. */
+	{ Mod1Mask, XK_space, togglekeymap, {.v = &keymaps[KeymapNative]} }, /* Latin and native. */
 	{ MODKEY, XK_x, killcurclient, {0} }, /* Close current window. */
 	{ MODKEY,  XK_b, togglebar, {0} }, /* Toggle bar with tags and other. */
 	{ MODKEY, XK_j, focusstack, {.i = +1, .b=1 } }, /* Change focus via keyboard(Next). */
@@ -181,6 +181,9 @@ static Key keys[] = {
 	{ MODKEY, XK_f, setlayout, {.v = &layouts[LayoutFloating]} }, /* Floating layout. */
 	{ MODKEY, XK_m, setlayout, {.v = &layouts[LayoutMonocle]} }, /* Maximized layout. */
 	{ MODKEY, XK_w, setlayout, {.v = &layouts[LayoutRootwin]} }, /* Layout with one window in mid. */
+	{ MODKEY, XK_g, setlayout, {.v = &layouts[LayoutGrid]} }, /* Grid layout. */
+	{ MODKEY, XK_c, setlayout, {.v = &layouts[LayoutCentered]} }, /* Centered master layout. */
+	{ MODKEY, XK_o, setlayout, {.v = &layouts[LayoutFibonacci]} }, /* Fibonacci layout. */
 	{ MODKEY|ShiftMask, XK_space,  setlayout, {0} },  /* Toggle layout. */
 	{ MODKEY, XK_space,  togglefree, {0} },  /* Change between floated and unfloated statement. */
 	{ MODKEY|ShiftMask, XK_f,  togglefullscreen, {0} },
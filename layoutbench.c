@@ -0,0 +1,85 @@
+/* See LICENSE file for copyright and license details.
+*
+* Times the planning layouts on 10 to 10000 clients without an X
+* connection: they are pure functions from "Layin" to "Plan", so they are
+* called straight from the WM source. Clients have a border and a few of
+* them size hints, as terminals do. */
+#define main xwm_main
+#include "main.c"
+#undef main
+
+#define MINTIME 0.2 /* Seconds each case runs at least. */
+
+static const int counts[] = { 10, 100, 1000, 10000 } ;
+
+static double
+nows(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(void)
+{
+	int *buf, i, j, n, nmax = counts[LENGTH(counts) - 1];
+	long reps, r;
+	float *aspects;
+	char *park;
+	double t;
+	Layin in = {0};
+	Plan out;
+
+	buf = ecalloc(13 * nmax, sizeof(int));
+	aspects = ecalloc(2 * nmax, sizeof(float));
+	park = ecalloc(nmax, 1);
+	for (i = 0; i < nmax; i++) {
+		buf[i] = 1 ; /* Border. */
+		if (i % 4 == 0) { /* Terminal: base size and cells. */
+			buf[nmax + i] = buf[9 * nmax + i] = 4 ;
+			buf[2 * nmax + i] = buf[10 * nmax + i] = 4 ;
+			buf[3 * nmax + i] = 7 ;
+			buf[4 * nmax + i] = 14 ;
+		}
+	}
+	in.bw = buf ; in.basew = buf + nmax ; in.baseh = buf + 2 * nmax ;
+	in.incw = buf + 3 * nmax ; in.inch = buf + 4 * nmax ;
+	out.x = buf + 5 * nmax ; out.y = buf + 6 * nmax ;
+	out.w = buf + 7 * nmax ; out.h = buf + 8 * nmax ;
+	in.minw = buf + 9 * nmax ; in.minh = buf + 10 * nmax ;
+	in.maxw = buf + 11 * nmax ; in.maxh = buf + 12 * nmax ;
+	in.mina = aspects ; in.maxa = aspects + nmax ;
+	out.park = park ;
+	in.nmaster = 1 ;
+	in.mfact = 0.55 ;
+	in.ww = 1920 ; in.wh = 1060 ; in.wy = 20 ;
+	in.hints = 1 ;
+	in.minsize = 20 ;
+
+	printf("%-6s %8s %12s %10s\n", "layout", "clients", "us/plan", "ns/client");
+	for (i = 0; i < LENGTH(layouts); i++) {
+		if (!layouts[i].plan)
+			continue;
+		in.symbol = layouts[i].symbol ;
+		for (j = 0; j < LENGTH(counts); j++) {
+			n = in.n = in.nvisible = counts[j] ;
+			in.sel = in.top = n / 2 ;
+			reps = 0 ;
+			t = nows();
+			do {
+				for (r = 0; r < 64; r++, reps++) {
+					memset(out.park, 0, n);
+					out.page = 0 ;
+					out.symbol[0] = '\0' ;
+					layouts[i].plan(&in, &out);
+				}
+			} while (nows() - t < MINTIME);
+			t = (nows() - t) / reps ;
+			printf("%-6s %8d %12.2f %10.1f\n", layouts[i].symbol, n,
+				t * 1e6, t * 1e9 / n);
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -20,24 +20,39 @@
 * To understand everything else, start reading "main()". */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <locale.h>
+#include <poll.h>
+#include <pwd.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <X11/cursorfont.h>
 #include <X11/keysym.h>
+#include <X11/XKBlib.h>
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
 #include <X11/Xproto.h>
+#include <X11/Xresource.h>
 #include <X11/Xutil.h>
+#include <X11/extensions/sync.h>
 #ifdef XINERAMA
 #include <X11/extensions/Xinerama.h>
 #endif /* XINERAMA */
+#ifdef XINPUT2
+#include <X11/extensions/XInput2.h>
+#include <X11/extensions/Xfixes.h>
+#endif /* XINPUT2 */
 #include <X11/Xft/Xft.h>
 
 #include "drw.h"
@@ -58,16 +73,27 @@
 #define TEXTW(X) (drw_fontset_getwidth(drw, (X)) + lrpad)
 #define SIZEL(X) (sizeof((X)[0]))
 #define MASK(X) (1>>(X))
+#define SPAWNMAX (1 << 16) /* Largest command line sent to the launcher. */
+#define EVSLICE 64 /* Cosmetic events handled before input is checked again. */
+#define ISSCROLL(F) ((F) == scrolldeskhorizontal || (F) == scrolldeskvertical)
+#define XISCROLLGAP 200 /* Milliseconds after which a scroll valuator starts over. */
+#define CELLSIZE 512 /* Side of canvas index cells in pixels. */
+#define NBUCKETS 64 /* Canvas index buckets per monitor, a power of two. */
 /* Enums. */
 enum { CurNormal, CurResize, CurMove, CurLast } ; /* Cursor */
 enum { SchemeNorm, SchemeSel } ; /* Color schemes. */
 enum { NetSupported, NetWMName, NetWMState, NetWMCheck,
        NetWMFullscreen, NetActiveWindow, NetWMWindowType,
-       NetWMWindowTypeDialog, NetClientList, NetLast } ; /* EWMH atoms. */
-enum { WMProtocols, WMDelete, WMState, WMTakeFocus, WMLast } ; /* Default atoms. */
+       NetWMWindowTypeDialog, NetClientList, NetClientListStacking,
+       NetNumberOfDesktops, NetCurrentDesktop, NetDesktopNames, NetWMDesktop,
+       NetDesktopViewport, NetWMSyncRequestCounter, NetLast } ; /* EWMH atoms. */
+enum { WMProtocols, WMDelete, WMState, WMTakeFocus, WMSyncRequest, WMLast } ; /* Default atoms. */
 enum { ClkTagBar, ClkLtSymbol, ClkStatusText, ClkWinTitle,
        ClkClientWin, ClkRootWin, ClkLast } ; /* Clicks. */
-enum {LayoutFloating, LayoutTile, LayoutMonocle, LayoutSplit, LayoutRootwin, LayoutLast} ;
+enum { EvInput, EvStructure, EvCosmetic, EvLast } ; /* Event priority classes. */
+enum { StackRaised, StackFree, StackTiled, StackHidden, StackLast } ; /* See "stacklayer". */
+enum {LayoutFloating, LayoutTile, LayoutMonocle, LayoutSplit, LayoutRootwin,
+      LayoutGrid, LayoutCentered, LayoutFibonacci, LayoutLast} ;
 enum {SideNo, SideRight, SideLeft, SideUp, SideDown} ;
 enum {
 	IsAny = ~0,
@@ -123,6 +149,23 @@ struct Client {
 	uint bw, oldbw; /* Border width in pixels. */
 	uint tags;
 	uint isfixed, isfree, isurgent, neverfocus, oldstate, isfullscreen;
+	uint catchall; /* Catch-all button grab of unfocused clients is set. */
+	long desktop; /* Last published _NET_WM_DESKTOP. */
+	/* Properties fetched on "manage" and again only on their "PropertyNotify". */
+	uint protocols; /* WM_PROTOCOLS as bits of "wmatom" indices. */
+	XWMHints wmh; /* WM_HINTS, if "haswmh". */
+	int haswmh;
+	Atom wtype; /* _NET_WM_WINDOW_TYPE. */
+	int titledirty; /* Title changed, fetched when it is drawn. */
+	XSyncCounter synccounter; /* _NET_WM_SYNC_REQUEST_COUNTER, see "syncrequest". */
+	XSyncAlarm syncalarm; /* Fires when the counter reaches "syncvalue". */
+	XSyncValue syncvalue; /* Last value asked for. */
+	long syncsent; /* Time of the pending request in ms, zero if none. */
+	int syncdeferred; /* Geometry changed while waiting, sent by "syncdone". */
+	int syncw, synch; /* Size last configured, moves are not synced. */
+	int incanvas; /* Indexed by its floating geometry, see "canvasadd". */
+	unsigned long canvasmark; /* Last "canvasquery" which returned it. */
+	int parked; /* Moved out of sight by "park", the next "resize" shows it. */
 	Client *next;
 	Client *snext;
 	Monitor *mon;
@@ -137,29 +180,124 @@ typedef struct {
 	const Arg arg;
 } Key ;
 
+/* Request serials whose errors are expected. */
+typedef struct {
+	unsigned long first, last;
+} Seqrange ;
+
+#ifdef XINPUT2
+/* Scroll valuator of a slave pointer, see "xiscroll". */
+typedef struct {
+	int deviceid, number, vertical;
+	double increment; /* Change of the value by one wheel click. */
+	double last; /* Value of the last event at "time", if "time" is set. */
+	double rest; /* Pixels left over from the last scroll. */
+	Time time;
+} Scrollaxis ;
+#endif /* XINPUT2 */
+
+/* Events of one priority class waiting to be handled. */
+typedef struct {
+	XEvent *ev;
+	int head, n, size;
+} Evqueue ;
+
+/* Clients of the canvas cells hashed to one bucket. */
+typedef struct {
+	Client **c;
+	int n, size;
+} Bucket ;
+
+/* Timer which "run" polls together with the X connection. */
+typedef struct {
+	int fd;
+	void (*func)(void);
+} Timer ;
+
+/* Pointer drag driven by "run", so other events keep being handled while
+* the pointer is grabbed. */
+typedef struct {
+	int type; /* Event ending the drag, zero if none is active. */
+	void (*done)(XButtonEvent *ev);
+	void (*apply)(Client *c, int x, int y); /* Live geometry update, "dragtick". */
+	Client *c; /* Dragged client, cleared by "unmanage". */
+	int x, y, moved; /* Last pointer position, not yet applied if "moved". */
+	int px, py; /* Pointer position to return to when "restore" is set. */
+	int restore;
+} Drag ;
+
 typedef struct {
 	int side;
 	void (*func)(const Arg *);
 	const Arg arg;
 } Side ;
 
-/* Structure defining function and string for layouts. */
+/* Input of a planning layout: the visible tiled clients of a monitor in
+* list order, packed one array per field so layouts never walk the lists. */
+typedef struct {
+	int n, nvisible; /* Tiled clients, all visible ones. */
+	int nmaster;
+	float mfact;
+	int wx, wy, ww, wh; /* Work area. */
+	int sel, top; /* Selected and topmost client, -1 if not tiled. */
+	int hints, minsize; /* See "planfit". */
+	const char *symbol;
+	const int *bw, *basew, *baseh, *incw, *inch;
+	const int *minw, *minh, *maxw, *maxh;
+	const float *mina, *maxa;
+} Layin ;
+
+/* Output of a planning layout: client geometry without borders. */
+typedef struct {
+	int *x, *y, *w, *h;
+	char *park; /* Not shown, see "park". */
+	uint page; /* Stack page, see "pagestack". */
+	char symbol[16]; /* Replaces the layout symbol if set. */
+} Plan ;
+
+/* Structure defining function and string for layouts. Tiled layouts are
+* pure "plan" functions, "arrangeplan" feeds and commits them. */
 typedef struct {
 	const char *symbol;
 	void (*arrange)(Monitor *);
+	void (*plan)(const Layin *in, Plan *out);
 } Layout ;
 
+/* Plan "arrangeplan" committed last for a view. Its key is the whole input
+* of the layout, so while it matches the layout would plan the same again. */
+typedef struct {
+	uint tags; /* View the plan was made for, zero if none. */
+	const Layout *lt;
+	float mfact;
+	int nmaster, wx, wy, ww, wh, sel, top, hints, minsize, nvisible;
+	uint pagein;
+	int n, size;
+	Client **c;
+	int *buf; /* Packed hints of "c" as in "Layin", then their geometry. */
+	char *park;
+	uint page;
+	char symbol[16];
+} Plancache ;
+
 struct Monitor {
 	char ltsymbol[16];
 	float mfact;
 	int nmaster;
 	int num;
 	int by; /* Bar geometry. */
+	int barx[ClkClientWin]; /* Right edges of bar segments by click, set by "drawbar". */
 	int mx, my, mw, mh; /* Screen size. */
 	int wx, wy, ww, wh; /* Window area.  */
+	int vx, vy; /* Canvas viewport origin, moved by "scrolldesk". */
+	int bardirty; /* Redrawn at the end of the round of "run". */
+	uint page; /* Stack page shown by "tile" and "split", see "pagestack". */
+	Bucket canvas[NBUCKETS]; /* Clients by canvas cells, see "canvasadd". */
+	int sdx, sdy; /* Scroll left to animate, see "scrolltick". */
+	int swarp; /* Pointer follows the animated scroll. */
 	uint seltags;
 	uint tagset[2];
 	SetupLayout taglt[9];
+	Plancache plans[9]; /* By "viewtag", see "arrangeplan". */
 	uint viewtag;
 	int showbar;
 	int topbar;
@@ -171,6 +309,12 @@ struct Monitor {
 	const Layout *lt;
 } ;
 
+/* Keyboard layout locked by "setkeymap". */
+typedef struct {
+	const char *name; /* Shown as status. */
+	uint group; /* XKB group of the map loaded by "startup". */
+} Keymap ;
+
 typedef struct {
 	const char *class;
 	const char *instance;
@@ -181,14 +325,27 @@ typedef struct {
 } Rule ;
 
 /* Function declarations. */
+static Timer *addtimer(void (*func)(void));
 static void applyrules(Client *c);
 static int applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact);
 static void arrange(Monitor *m);
 static void arrangemon(Monitor *m);
+static void arrangeplan(Monitor *m);
+static void dropplans(Monitor *m);
+static int planhit(Plancache *pc, Monitor *m, const Layin *in, Client **cs);
+static void replayplan(Plancache *pc, Monitor *m, Client **cs);
+static void saveplan(Plancache *pc, Monitor *m, const Layin *in, const Plan *out, Client **cs);
 static void attach(Client *c);
 static void attachstack(Client *c);
+static int bitid(uint bits);
 static void buttonpress(XEvent *e);
-static Client* clientclick(uint waitRelease, uint returnCurrentIfNoChoosen);
+static void buttonrelease(XEvent *e);
+static void canvasadd(Client *c);
+static void canvasdel(Client *c);
+static int canvasquery(Monitor *m, int x, int y, int w, int h, Client ***res);
+static int cellbuckets(int x, int y, int w, int h, int *b);
+static int cellof(int v);
+static void centeredmaster(const Layin *in, Plan *out);
 static void checkotherwm(void);
 static void cleanup(void);
 static void cleanupmon(Monitor *mon);
@@ -200,9 +357,14 @@ static Monitor *createmon(void);
 static void destroynotify(XEvent *e);
 static void detach(Client *c);
 static void detachstack(Client *c);
+static void dispatch(Evqueue *q, int max);
 static Monitor *dirtomon(int dir);
+static int forkexec(char **argv);
 static void drawbar(Monitor *m);
 static void drawbars(void);
+static void drawdirtybars(void);
+static void dragtick(void);
+static void enddrag(XButtonEvent *ev);
 static void enternotify(XEvent *e);
 static void expose(XEvent *e);
 static void floating(Monitor *m);
@@ -214,41 +376,72 @@ static void lowerclient(Client *c);
 static void lowerfocused(const Arg *arg);
 static void focusin(XEvent *e);
 static void focusmon(const Arg *arg);
+static void fibonacci(const Layin *in, Plan *out);
 static void focusstack(const Arg *arg);
 static int getrootptr(int *x, int *y);
+static void grid(const Layin *in, Plan *out);
+static void handovermon(Client *c);
 static long getstate(Window w);
 static int gettextprop(Window w, Atom atom, char *text, uint size);
+static void ignoreend(void);
+static void ignorestart(void);
+static void grabbindings(void);
 static void grabbuttons(Client *c, int focused);
 static void grabkeys(void);
 static void incnmaster(const Arg *arg);
+static int intersects(Monitor *m, int x, int y, int w, int h);
+static int isbound(uint click, uint button, uint state);
 static void keypress(XEvent *e);
 static void killcurclient(const Arg *arg);
 static void killclick(const Arg *arg);
+static void livedragc(Client *c, void (*apply)(Client *c, int x, int y));
+static void killpicked(XButtonEvent *ev);
 static void manage(Window w, XWindowAttributes *wa);
 static void mappingnotify(XEvent *e);
+static void mergeresources(const char *path);
 static void maprequest(XEvent *e);
-static void monocle(Monitor *m);
+static void monocle(const Layin *in, Plan *out);
 static void motionnotify(XEvent *e);
+static int pagestack(const Layin *in, Plan *out, int *first);
+static void park(Client *c);
+static void planfit(const Layin *in, int i, int *w, int *h);
+static void planplace(const Layin *in, Plan *out, int i, int x, int y, int w, int h);
 static void movemouse(const Arg *arg);
 static void moveclick(const Arg *arg);
+static void moveapply(Client *c, int x, int y);
+static void movedone(XButtonEvent *ev);
+static void movepicked(XButtonEvent *ev);
+static Client *pickedclient(XButtonEvent *ev);
 static void moveWins(Monitor *m, int dx, int dy);
 static uint nClients(Monitor *m, uint m);
+static long nowms(void);
 static Client *nextclient(Client *c, uint m);
 static uint ckclient(Client *c, uint m);
 static void nextlayout(const Arg *arg);
 static void pop(Client *);
 static void propertynotify(XEvent *e);
+static void printcounters(void);
+static void publishclientlist(void);
+static void publishdesktops(void);
 static void quit(const Arg *arg);
+static void queueevents(void);
+static void readsignals(void);
+static void reap(void);
 static Monitor *recttomon(int x, int y, int w, int h);
-static void rootwin(Monitor *m);
+static void rootwin(const Layin *in, Plan *out);
 static void resize(Client *c, int x, int y, int w, int h, int interact);
 static void resizeclient(Client *c, int x, int y, int w, int h);
+static void configureclient(Client *c);
 static void resizemouse(const Arg *arg);
 static void resizeclick(const Arg *arg);
+static void resizeapply(Client *c, int x, int y);
+static void resizedone(XButtonEvent *ev);
+static void resizepicked(XButtonEvent *ev);
 static void restack(Monitor *m);
 static void run(void);
+static void runlauncher(int fd);
 static void scan(void);
-static int sendevent(Client *c, Atom proto);
+static int sendevent(Client *c, int proto);
 static void sendmon(Client *c, Monitor *m);
 static void setOldGeometry(Client *c, int x, int y, uint w, uint h);
 static void setFloatingGeometry(Client *c, int x, int y, uint w, uint h);
@@ -256,25 +449,40 @@ static void setFreeGeometry(Client *c, int x, int y, uint w, uint h);
 static void setGeometry(Client *c, int x, int y, uint w, uint h);
 static void setWCGeometry(XWindowChanges *wc, int x, int y, uint w, uint h);
 static void setclientstate(Client *c, long state);
+static void setclienttags(Client *c, uint tags);
 static void setfocus(Client *c);
 static void setfullscreen(Client *c, int fullscreen);
+static void setkeymap(const Arg *arg);
 static void setlayout(const Arg *arg);
 static void setmfact(const Arg *arg);
+static void setstatus(const char *text);
+static void settimer(Timer *t, long ms, int repeat);
 static void setup(void);
+static void syncdone(Client *c);
+static void syncnotify(XEvent *e);
+static void syncrequest(Client *c);
+static void synctick(void);
+static void setupbuttons(void);
 static void seturgent(Client *c, int urg);
 static void showhide(Client *c);
-static void sigchld(int unused);
 static void spawn(const Arg *arg);
+static int stacklayer(Client *c);
+static void startlauncher(void);
+static void startup(void);
 static void scrolldesk(Monitor *m, int dx, int dy, int mvptr);
 static void scrolldeskhorizontal(const Arg *arg);
 static void scrolldeskvertical(const Arg *arg);
-static void sidehandle(void);
+static void scrollby(Monitor *m, int dx, int dy, int warpptr);
+static void scrolltick(void);
+static void sidehandle(int x, int y);
+static int snapsplit(const Layin *in, int size, int horizontal);
 static void tag(const Arg *arg);
 static void tagmon(const Arg *arg);
-static void tile(Monitor *);
-static void split(Monitor *);
+static void tile(const Layin *in, Plan *out);
+static void split(const Layin *in, Plan *out);
 static void togglebar(const Arg *arg);
 static void togglefree(const Arg *arg);
+static void togglekeymap(const Arg *arg);
 static void toggletag(const Arg *arg);
 static void toggleview(const Arg *arg);
 static void unfocus(Client *c, int setfocus);
@@ -283,9 +491,12 @@ static void unmapnotify(XEvent *e);
 static void updatebarpos(Monitor *m);
 static void updatebars(void);
 static void updateclientlist(void);
+static void updatedesktops(void);
 static int updategeom(void);
 static void updatenumlockmask(void);
+static void updateprotocols(Client *c);
 static void updatesizehints(Client *c);
+static void updatesynccounter(Client *c);
 static void updatestatus(void);
 static void updatetitle(Client *c);
 static void updatewindowtype(Client *c);
@@ -294,12 +505,19 @@ static void view(const Arg *arg);
 static void viewnext(const Arg *arg);
 static Client *wintoclient(Window w);
 static Monitor *wintomon(Window w);
-static int waitmouse(XEvent *ev, int type);
+static int startdrag(int type, int cur, void (*done)(XButtonEvent *ev));
 static int xerror(Display *dpy, XErrorEvent *ee);
-static int xerrordummy(Display *dpy, XErrorEvent *ee);
 static int xerrorstart(Display *dpy, XErrorEvent *ee);
+static void xkbnotify(XEvent *e);
 static void zoom(const Arg *arg);
-uint isCancelClickGestureDone(void);
+#ifdef XINPUT2
+static void setupxi(void);
+static void updatebarriers(void);
+static void updatescrollaxes(void);
+static void xievent(XEvent *e);
+static void xiscroll(XIDeviceEvent *ev);
+#endif /* XINPUT2 */
+uint isCancelClickGestureDone(int x, int y);
 static void togglefullscreen(const Arg *arg);
 
 /* Variables. */
@@ -307,12 +525,39 @@ static const char broken[] = "broken" ;
 static char stext[256];
 static int screen;
 static int sw, sh;           /* X display screen geometry width, height. */
-static int bh, blw = 0;      /* Bar geometry. */
+static int bh;               /* Bar geometry. */
 static int lrpad;            /* Sum of left and right padding for text. */
 static int (*xerrorxlib)(Display *, XErrorEvent *);
 static uint numlockmask = 0;
+static int xkb = 0; /* XKB extension is available. */
+static int xkbevbase = -1 ; /* XKB event type, negative without the extension. */
+static const Keymap *keymap, *prevkeymap; /* Locked layout and the one before it. */
+static int launcherfd = -1; /* WM end of the launcher socket. */
+static int sigfd = -1; /* SIGCHLD, SIGHUP and SIGTERM are read from it in "run". */
+static sigset_t origmask; /* Signal mask to restore in children. */
+static Seqrange ignores[256]; /* See "ignorestart". */
+static int nignores = 0 ;
+static Timer timers[8];
+static int ntimers = 0 ;
+static Drag drag;
+static Timer *dragtimer; /* Paces live drags, see "dragtick". */
+static int batchsync = 0 ; /* "arrange" syncs once for all clients it configures. */
+static int syncevbase = -1 ; /* First XSync event, negative without the extension. */
+static Timer *scrolltimer; /* Frame clock of smooth scrolling. */
+static Timer *synctimer; /* Gives up on clients late with their counter. */
+static int syncwaiting = 0 ; /* Clients with a pending sync request. */
+#ifdef XINPUT2
+static int xiopcode = -1 ; /* XInput extension opcode, negative without XI 2.1. */
+static Scrollaxis scrollaxes[32];
+static int nscrollaxes = 0 ;
+static long xiscrolled = 0 ; /* When "xiscroll" last scrolled, in ms. */
+static int barriers = 0 ; /* XI 2.3 and XFixes 5 pointer barriers are available. */
+static PointerBarrier edges[4]; /* On the screen edges, see "updatebarriers". */
+static BarrierEventID edgeevent = 0 ; /* Push against an edge "sidehandle" ran for. */
+#endif /* XINPUT2 */
 static void (*handler[LASTEvent]) (XEvent *) = {
 	[ButtonPress] = buttonpress,
+	[ButtonRelease] = buttonrelease,
 	[ClientMessage] = clientmessage,
 	[ConfigureRequest] = configurerequest,
 	[ConfigureNotify] = configurenotify,
@@ -325,8 +570,37 @@ static void (*handler[LASTEvent]) (XEvent *) = {
 	[MapRequest] = maprequest,
 	[MotionNotify] = motionnotify,
 	[PropertyNotify] = propertynotify,
-	[UnmapNotify] = unmapnotify
+	[UnmapNotify] = unmapnotify,
+#ifdef XINPUT2
+	[GenericEvent] = xievent,
+#endif /* XINPUT2 */
+};
+/* Input is handled first, then structure, cosmetics when nothing else waits. */
+static const int evclass[LASTEvent] = {
+	[ButtonPress] = EvInput,
+	[ButtonRelease] = EvInput,
+	[EnterNotify] = EvInput,
+	[FocusIn] = EvInput,
+	[GenericEvent] = EvInput,
+	[KeyPress] = EvInput,
+	[MappingNotify] = EvInput,
+	[MotionNotify] = EvInput,
+	[ClientMessage] = EvStructure,
+	[ConfigureNotify] = EvStructure,
+	[ConfigureRequest] = EvStructure,
+	[DestroyNotify] = EvStructure,
+	[MapRequest] = EvStructure,
+	[UnmapNotify] = EvStructure,
+	[Expose] = EvCosmetic,
+	[PropertyNotify] = EvCosmetic,
 };
+static Evqueue evqueue[EvLast];
+static int clientlistdirty = 0 ; /* See "updateclientlist". */
+static Window *clientlist[2]; /* Last published _NET_CLIENT_LIST and _NET_CLIENT_LIST_STACKING. */
+static int nclientlist[2];
+static int desktopsdirty = 0 ; /* See "updatedesktops". */
+static long netdesktop = -1; /* Last published root value. */
+static unsigned long titlenotifies = 0, titlefetches = 0 ; /* Title changes and lazy fetches of them. */
 static Atom wmatom[WMLast], netatom[NetLast];
 static int restart = 0 ;
 static int running = 1 ;
@@ -345,8 +619,29 @@ static char *argv0;
 /* Compile-time check if all tags fit into an unsigned int bit array. */
 struct NumTags { char limitexceeded[LENGTH(tags) > 31 ? -1 : 1]; };
 
+/* Right edges of tag labels, the same on every bar. */
+static int tagx[LENGTH(tags)];
+/* "buttons" grouped by click and then by button, see "setupbuttons". */
+static const Button *clkbuttons[LENGTH(buttons)];
+static uint clkbuttonsoff[ClkLast + 1];
+
 /* Function implementations. */
 
+Timer *
+addtimer(void (*func)(void))
+{
+	Timer *t;
+
+	if (ntimers >= LENGTH(timers))
+		die("%s: too many timers", argv0);
+	t = &timers[ntimers];
+	if ((t->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC|TFD_NONBLOCK)) < 0)
+		die("timerfd_create:");
+	t->func = func;
+	ntimers++;
+	return t;
+}
+
 void
 applyrules(Client *c)
 {
@@ -470,12 +765,21 @@ arrange(Monitor *m)
 			showhide(m->stack);
 		}
 	}
+	/* Clients are configured without a round trip each, one sync below
+	* covers them all. */
+	batchsync = 1 ;
 	if( m ){
 		arrangemon(m);
-		restack(m);
-	} else for (m = mons; m; m = m->next){
-		arrangemon(m);
+	} else {
+		for (m = mons; m; m = m->next)
+			arrangemon(m);
 	}
+	batchsync = 0 ;
+	XSync(dpy, False);
+	if( m )
+		restack(m);
+	updateclientlist();
+	updatedesktops();
 }
 
 void
@@ -486,11 +790,188 @@ arrangemon(Monitor *m)
 	
 }
 
+/* Runs the planning layout of "m" on its visible tiled clients and commits
+* the plan: parks the clients it hides and resizes the others. */
+void
+arrangeplan(Monitor *m)
+{
+	static int *buf, size;
+	static float *aspects;
+	static char *parked;
+	static Client **cs;
+	Layin in;
+	Plan out;
+	Plancache *pc;
+	Client *c, *top;
+	int i, n;
+
+	if (!(n = nClients(m, IsVisible|IsTile)))
+		return;
+	if (n > size) {
+		size = MAX(2 * size, n);
+		if (!(buf = realloc(buf, 13 * size * sizeof(int)))
+				|| !(aspects = realloc(aspects, 2 * size * sizeof(float)))
+				|| !(parked = realloc(parked, size))
+				|| !(cs = realloc(cs, size * sizeof(Client *))))
+			die("realloc:");
+	}
+	in.bw = buf ; in.basew = buf + size ; in.baseh = buf + 2 * size ;
+	in.incw = buf + 3 * size ; in.inch = buf + 4 * size ;
+	out.x = buf + 5 * size ; out.y = buf + 6 * size ;
+	out.w = buf + 7 * size ; out.h = buf + 8 * size ;
+	in.minw = buf + 9 * size ; in.minh = buf + 10 * size ;
+	in.maxw = buf + 11 * size ; in.maxh = buf + 12 * size ;
+	in.mina = aspects ; in.maxa = aspects + size ;
+	out.park = parked ;
+	for (top = m->stack; top && !ckclient(top, IsTile|IsVisible); top = top->snext);
+	in.sel = in.top = -1 ;
+	for (i = 0, c = nextclient(m->clients, IsTile|IsVisible); c;
+			c = nextclient(c->next, IsTile|IsVisible), i++) {
+		cs[i] = c ;
+		buf[i] = c->bw ;
+		buf[size + i] = c->basew ;
+		buf[2 * size + i] = c->baseh ;
+		buf[3 * size + i] = c->incw ;
+		buf[4 * size + i] = c->inch ;
+		buf[9 * size + i] = c->minw ;
+		buf[10 * size + i] = c->minh ;
+		buf[11 * size + i] = c->maxw ;
+		buf[12 * size + i] = c->maxh ;
+		aspects[i] = c->mina ;
+		aspects[size + i] = c->maxa ;
+		if (c == m->sel)
+			in.sel = i ;
+		if (c == top)
+			in.top = i ;
+	}
+	in.n = n ;
+	in.nvisible = nClients(m, IsVisible);
+	in.nmaster = m->nmaster ;
+	in.mfact = m->mfact ;
+	in.wx = m->wx ; in.wy = m->wy ; in.ww = m->ww ; in.wh = m->wh ;
+	in.hints = resizehints ;
+	in.minsize = bh ;
+	in.symbol = m->lt->symbol ;
+	pc = m->viewtag < LENGTH(m->plans) ? &m->plans[m->viewtag] : NULL ;
+	if (pc && planhit(pc, m, &in, cs)) {
+		replayplan(pc, m, cs);
+		return;
+	}
+	memset(out.park, 0, n);
+	out.page = m->page ;
+	out.symbol[0] = '\0' ;
+	m->lt->plan(&in, &out);
+	if (pc)
+		pc->pagein = m->page ;
+	m->page = out.page ;
+	if (out.symbol[0])
+		strncpy(m->ltsymbol, out.symbol, sizeof m->ltsymbol);
+	for (i = 0; i < n; i++)
+		if (out.park[i])
+			park(cs[i]);
+		else
+			resize(cs[i], out.x[i], out.y[i], out.w[i], out.h[i], 0);
+	if (pc)
+		saveplan(pc, m, &in, &out, cs);
+}
+
+/* Forgets the plans of "m", after a client went away or changed its hints,
+* which the key does not cover fully. */
+void
+dropplans(Monitor *m)
+{
+	int i;
+
+	for (i = 0; i < LENGTH(m->plans); i++)
+		m->plans[i].tags = 0 ;
+}
+
+int
+planhit(Plancache *pc, Monitor *m, const Layin *in, Client **cs)
+{
+	const int *keys[] = { in->bw, in->basew, in->baseh, in->incw, in->inch };
+	int i, n = in->n ;
+
+	if (pc->tags != m->tagset[m->seltags] || pc->lt != m->lt
+			|| pc->mfact != in->mfact || pc->nmaster != in->nmaster
+			|| pc->wx != in->wx || pc->wy != in->wy
+			|| pc->ww != in->ww || pc->wh != in->wh
+			|| pc->sel != in->sel || pc->top != in->top
+			|| pc->hints != in->hints || pc->minsize != in->minsize
+			|| pc->nvisible != in->nvisible || pc->pagein != m->page
+			|| pc->n != n
+			|| memcmp(pc->c, cs, n * sizeof(Client *)))
+		return 0;
+	for (i = 0; i < LENGTH(keys); i++)
+		if (memcmp(pc->buf + i * n, keys[i], n * sizeof(int)))
+			return 0;
+	return 1;
+}
+
+/* Commits a cached plan again. Clients already in place are skipped, the
+* others get their geometry as it was, without "applysizehints". */
+void
+replayplan(Plancache *pc, Monitor *m, Client **cs)
+{
+	int i, n = pc->n, *g = pc->buf + 5 * n ;
+	Client *c;
+
+	for (i = 0; i < n; i++) {
+		c = cs[i] ;
+		if (pc->park[i])
+			park(c);
+		else if (c->parked || c->x != g[i] || c->y != g[n + i]
+				|| (int)c->w != g[2 * n + i] || (int)c->h != g[3 * n + i])
+			resizeclient(c, g[i], g[n + i], g[2 * n + i], g[3 * n + i]);
+	}
+	m->page = pc->page ;
+	if (pc->symbol[0])
+		strncpy(m->ltsymbol, pc->symbol, sizeof m->ltsymbol);
+}
+
+void
+saveplan(Plancache *pc, Monitor *m, const Layin *in, const Plan *out, Client **cs)
+{
+	const int *keys[] = { in->bw, in->basew, in->baseh, in->incw, in->inch };
+	int i, n = in->n, *g;
+
+	if (n > pc->size) {
+		pc->size = MAX(2 * pc->size, n);
+		if (!(pc->c = realloc(pc->c, pc->size * sizeof(Client *)))
+				|| !(pc->buf = realloc(pc->buf, 9 * pc->size * sizeof(int)))
+				|| !(pc->park = realloc(pc->park, pc->size)))
+			die("realloc:");
+	}
+	pc->tags = m->tagset[m->seltags] ;
+	pc->lt = m->lt ;
+	pc->mfact = in->mfact ;
+	pc->nmaster = in->nmaster ;
+	pc->wx = in->wx ; pc->wy = in->wy ; pc->ww = in->ww ; pc->wh = in->wh ;
+	pc->sel = in->sel ; pc->top = in->top ;
+	pc->hints = in->hints ; pc->minsize = in->minsize ;
+	pc->nvisible = in->nvisible ;
+	pc->n = n ;
+	memcpy(pc->c, cs, n * sizeof(Client *));
+	for (i = 0; i < LENGTH(keys); i++)
+		memcpy(pc->buf + i * n, keys[i], n * sizeof(int));
+	g = pc->buf + 5 * n ;
+	for (i = 0; i < n; i++) {
+		g[i] = cs[i]->x ;
+		g[n + i] = cs[i]->y ;
+		g[2 * n + i] = cs[i]->w ;
+		g[3 * n + i] = cs[i]->h ;
+	}
+	memcpy(pc->park, out->park, n);
+	pc->page = out->page ;
+	memcpy(pc->symbol, out->symbol, sizeof pc->symbol);
+}
+
 void
 attach(Client *c)
 {
 	c->next = c->mon->clients ;
 	c->mon->clients = c ;
+	canvasadd(c);
 }
 
 void
@@ -503,93 +984,253 @@ attachstack(Client *c)
 void
 buttonpress(XEvent *e)
 {
-	uint i, x, click;
+	uint i, click;
+	int grabbed;
 	Arg arg = {0};
+	const Button *b;
 	Client *c;
 	Monitor *m;
 	XButtonPressedEvent *ev = &e->xbutton;
 
+	if (drag.type) {
+		if (drag.type == ButtonPress)
+			enddrag(ev);
+		return;
+	}
 	click = ClkRootWin;
+	/* Client bindings are grabbed on root, see "grabbindings". Presses are
+	* delivered to the client or bar under the pointer as they would be
+	* without, with coordinates from the origins the WM placed them at.
+	* Presses over any other window, like override-redirect popups, are
+	* replayed to it. */
+	if ((grabbed = ev->window == root) && ev->subwindow) {
+		if ((c = wintoclient(ev->subwindow))
+				&& isbound(ClkClientWin, ev->button, ev->state)) {
+			ev->window = c->win;
+			ev->x = ev->x_root - c->x - c->bw;
+			ev->y = ev->y_root - c->y - c->bw;
+		} else if ((m = wintomon(ev->subwindow)) && ev->subwindow == m->barwin) {
+			ev->window = m->barwin;
+			ev->x = ev->x_root - m->wx;
+			ev->y = ev->y_root - m->by;
+		} else {
+			XAllowEvents(dpy, ReplayPointer, CurrentTime);
+			return;
+		}
+	}
+	if (grabbed)
+		XAllowEvents(dpy, AsyncPointer, CurrentTime);
 	/* Focus monitor if necessary. */
-	if ((m = wintomon(ev->window)) && m != selmon) {
+	m = ev->window == root ? recttomon(ev->x_root, ev->y_root, 1, 1)
+		: wintomon(ev->window);
+	if (m && m != selmon) {
 		unfocus(selmon->sel, 1);
 		selmon = m;
 		focus(NULL);
 	}
 	if (ev->window == selmon->barwin) {
-		i = x = 0;
-		do
-			x += TEXTW(tags[i]);
-		while (ev->x >= x && ++i < LENGTH(tags));
-		if (i < LENGTH(tags)) {
+		if (ev->x < selmon->barx[ClkTagBar]) {
+			for (i = 0; i < LENGTH(tags) - 1 && ev->x >= tagx[i]; i++);
 			click = ClkTagBar;
 			arg.ui = 1 << i;
-		} else if (ev->x < x + blw)
+		} else if (ev->x < selmon->barx[ClkLtSymbol])
 			click = ClkLtSymbol;
-		else if (ev->x > selmon->ww - TEXTW(stext))
-			click = ClkStatusText;
-		else
+		else if (ev->x < selmon->barx[ClkWinTitle])
 			click = ClkWinTitle;
+		else
+			click = ClkStatusText;
 	} else if ((c = wintoclient(ev->window))) {
 		focus(c);
 		restack(selmon);
-		XAllowEvents(dpy, ReplayPointer, CurrentTime);
+		/* Passes on the presses of the catch-all grab of "grabbuttons". */
+		if (!grabbed)
+			XAllowEvents(dpy, ReplayPointer, CurrentTime);
 		click = ClkClientWin;
 	}
-	for (i = 0; i < LENGTH(buttons); i++)
-		if (click == buttons[i].click && buttons[i].func && buttons[i].button == ev->button
-				&& CLEANMASK(buttons[i].mask) == CLEANMASK(ev->state))
-			buttons[i].func(click == ClkTagBar && buttons[i].arg.i == 0 ? &arg : &buttons[i].arg);
+	/* Only bindings of this click are scanned and they are sorted by button. */
+	for (i = clkbuttonsoff[click]; i < clkbuttonsoff[click + 1]
+			&& clkbuttons[i]->button <= ev->button; i++) {
+		b = clkbuttons[i];
+#ifdef XINPUT2
+		/* Emulated by the server for a motion "xiscroll" scrolled by. */
+		if (b->button >= Button4 && ISSCROLL(b->func)
+				&& nowms() - xiscrolled < XISCROLLGAP)
+			continue;
+#endif /* XINPUT2 */
+		if (b->button == ev->button && b->func
+				&& CLEANMASK(b->mask) == CLEANMASK(ev->state))
+			b->func(click == ClkTagBar && b->arg.i == 0 ? &arg : &b->arg);
+	}
+}
+
+void
+buttonrelease(XEvent *e)
+{
+	if (drag.type == ButtonRelease)
+		enddrag(&e->xbutton);
 }
 
+/* Client clicked to end a pick drag, the selected one if it was not on a
+* client, none if the pick was cancelled. */
 Client *
-clientclick(uint waitButtonRelease, uint returnCurrentIfNoChoosen)
+pickedclient(XButtonEvent *ev)
 {
 	Client *c;
-	int x, y;
-	Window win;
-	XEvent ev;
-	
-	if( XGrabPointer(dpy, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
-			None, cursor[CurMove]->cursor, CurrentTime)
-			!= GrabSuccess)
-		return 0 ;
-		
-	do{
-		XMaskEvent(dpy, MOUSEMASK|ExposureMask|SubstructureRedirectMask, &ev);
-		switch( ev.type ){
-		case ConfigureRequest :
-		case Expose :
-		case MapRequest :
-			handler[ev.type](&ev);
-		case MotionNotify:
-			sidehandle();
-		break;
-		}
-	}while( ev.type != ButtonPress );
-	if(waitButtonRelease)
-		waitmouse(&ev, ButtonRelease);
-	
-	XUngrabPointer(dpy, CurrentTime) ;
 
-	win = ev.xbutton.subwindow ;
-	if( isCancelClickGestureDone() || win == root )
-		return 0 ;
-	if( !(c = wintoclient(win)) && returnCurrentIfNoChoosen )
+	if( isCancelClickGestureDone(ev->x_root, ev->y_root) )
+		return NULL ;
+	if( !(c = wintoclient(ev->subwindow)) )
 		c = selmon->sel ;
-
 	return c ;
 }
 
+/* Pointer at the top left corner, "x" and "y" come from the event. */
 uint
-isCancelClickGestureDone(void)
+isCancelClickGestureDone(int x, int y)
 {
-	int x, y;
-	if(getrootptr(&x, &y) && !x && !y)
+	if(!x && !y)
 		return 1 ;
 	return 0 ;
 }
 
+/* Cell of canvas coordinate "v", rounding down for negative ones too. */
+int
+cellof(int v)
+{
+	return v >= 0 ? v / CELLSIZE : -((-v - 1) / CELLSIZE) - 1;
+}
+
+/* Buckets of the cells the canvas rectangle covers, all of them if it covers
+* more cells than there are buckets. Returns their number. */
+int
+cellbuckets(int x, int y, int w, int h, int *b)
+{
+	int i, j, n = 0, x0 = cellof(x), y0 = cellof(y),
+		x1 = cellof(x + MAX(w, 1) - 1), y1 = cellof(y + MAX(h, 1) - 1);
+
+	if ((long)(x1 - x0 + 1) * (y1 - y0 + 1) > NBUCKETS) {
+		for (i = 0; i < NBUCKETS; i++)
+			b[i] = i;
+		return NBUCKETS;
+	}
+	for (i = x0; i <= x1; i++)
+		for (j = y0; j <= y1; j++)
+			b[n++] = ((uint)i * 73856093u ^ (uint)j * 19349663u) & (NBUCKETS - 1);
+	return n;
+}
+
+/* Indexes "c" on the canvas of its monitor by its floating geometry, borders
+* left out, so "canvasquery" finds the clients of a viewport without walking
+* all of them. */
+void
+canvasadd(Client *c)
+{
+	int b[NBUCKETS], i, n;
+	Bucket *k;
+
+	n = cellbuckets(c->fx, c->fy, c->fw, c->fh, b);
+	for (i = 0; i < n; i++) {
+		k = &c->mon->canvas[b[i]];
+		if (k->n && k->c[k->n - 1] == c)
+			continue; /* Cells sharing a bucket. */
+		if (k->n == k->size) {
+			k->size = k->size ? 2 * k->size : 8;
+			if (!(k->c = realloc(k->c, k->size * sizeof(Client *))))
+				die("realloc:");
+		}
+		k->c[k->n++] = c;
+	}
+	c->incanvas = 1 ;
+}
+
+/* Drops "c" from the index, its floating geometry must be the indexed one. */
+void
+canvasdel(Client *c)
+{
+	int b[NBUCKETS], i, j, n;
+	Bucket *k;
+
+	if (!c->incanvas)
+		return;
+	n = cellbuckets(c->fx, c->fy, c->fw, c->fh, b);
+	for (i = 0; i < n; i++) {
+		k = &c->mon->canvas[b[i]];
+		for (j = 0; j < k->n; j++)
+			if (k->c[j] == c)
+				k->c[j--] = k->c[--k->n];
+	}
+	c->incanvas = 0 ;
+}
+
+/* Clients of "m" whose floating geometry intersects the canvas rectangle.
+* "res" is valid until the next call. */
+int
+canvasquery(Monitor *m, int x, int y, int w, int h, Client ***res)
+{
+	static Client **buf;
+	static int size;
+	static unsigned long mark;
+	int b[NBUCKETS], i, j, nb, n = 0;
+	Bucket *k;
+	Client *c;
+
+	mark++;
+	nb = cellbuckets(x, y, w, h, b);
+	for (i = 0; i < nb; i++) {
+		k = &m->canvas[b[i]];
+		for (j = 0; j < k->n; j++) {
+			c = k->c[j];
+			if (c->canvasmark == mark
+					|| c->fx >= x + w || c->fx + (int)c->fw <= x
+					|| c->fy >= y + h || c->fy + (int)c->fh <= y)
+				continue;
+			c->canvasmark = mark ;
+			if (n == size) {
+				size = size ? 2 * size : 64;
+				if (!(buf = realloc(buf, size * sizeof(Client *))))
+					die("realloc:");
+			}
+			buf[n++] = c;
+		}
+	}
+	*res = buf;
+	return n;
+}
+
+/* Master column in the middle, the stack split to both sides of it. */
+void
+centeredmaster(const Layin *in, Plan *out)
+{
+	int i, h, mw, mx, my, tw, ly, ry, *ty;
+
+	mw = tw = in->ww ;
+	mx = 0 ;
+	if (in->n > in->nmaster) {
+		mw = in->nmaster ? snapsplit(in, in->ww * in->mfact, 1) : 0 ;
+		tw = in->ww - mw ;
+		if (in->n - in->nmaster > 1) {
+			mx = tw / 2 ;
+			tw = (in->ww - mw) / 2 ;
+		}
+	}
+	for (i = my = ly = ry = 0; i < in->n; i++) {
+		if (i < in->nmaster) {
+			h = (in->wh - my) / (MIN(in->n, in->nmaster) - i) ;
+			planplace(in, out, i, in->wx + mx, in->wy + my,
+				mw - 2 * in->bw[i], h - 2 * in->bw[i]);
+			my += out->h[i] + 2 * in->bw[i] ;
+			continue;
+		}
+		/* Right and left column by turns, the right one first. */
+		ty = (i - in->nmaster) % 2 ? &ly : &ry ;
+		h = (in->wh - *ty) / ((1 + in->n - i) / 2) ;
+		planplace(in, out, i,
+			in->wx + ((i - in->nmaster) % 2 ? 0 : mx + mw), in->wy + *ty,
+			tw - 2 * in->bw[i], h - 2 * in->bw[i]);
+		*ty += out->h[i] + 2 * in->bw[i] ;
+	}
+}
+
 void
 checkotherwm(void)
 {
@@ -605,7 +1246,7 @@ void
 cleanup(void)
 {
 	Arg a = {.ui = ~0};
-	Layout foo = { "", NULL };
+	Layout foo = { "", NULL, NULL };
 	Monitor *m;
 	size_t i;
 
@@ -615,6 +1256,7 @@ cleanup(void)
 		while (m->stack)
 			unmanage(m->stack, 0);
 	XUngrabKey(dpy, AnyKey, AnyModifier, root);
+	XUngrabButton(dpy, AnyButton, AnyModifier, root);
 	while (mons)
 		cleanupmon(mons);
 	for (i = 0; i < CurLast; i++)
@@ -623,15 +1265,19 @@ cleanup(void)
 		free(scheme[i]);
 	XDestroyWindow(dpy, wmcheckwin);
 	drw_free(drw);
+	if (launcherfd >= 0)
+		close(launcherfd);
 	XSync(dpy, False);
 	XSetInputFocus(dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
 	XDeleteProperty(dpy, root, netatom[NetActiveWindow]);
+	printcounters();
 }
 
 void
 cleanupmon(Monitor *mon)
 {
 	Monitor *m;
+	int i;
 
 	if (mon == mons)
 		mons = mons->next;
@@ -641,6 +1287,13 @@ cleanupmon(Monitor *mon)
 	}
 	XUnmapWindow(dpy, mon->barwin);
 	XDestroyWindow(dpy, mon->barwin);
+	for (i = 0; i < NBUCKETS; i++)
+		free(mon->canvas[i].c);
+	for (i = 0; i < LENGTH(mon->plans); i++) {
+		free(mon->plans[i].c);
+		free(mon->plans[i].buf);
+		free(mon->plans[i].park);
+	}
 	free(mon);
 }
 
@@ -649,9 +1302,24 @@ clientmessage(XEvent *e)
 {
 	XClientMessageEvent *cme = &e->xclient;
 	Client *c = wintoclient(cme->window);
+	Arg a;
 
+	if (cme->message_type == netatom[NetCurrentDesktop]) {
+		if (cme->data.l[0] >= 0 && cme->data.l[0] < LENGTH(tags)) {
+			a.ui = 1 << cme->data.l[0];
+			view(&a);
+		}
+		return;
+	}
 	if (!c)
 		return;
+	if (cme->message_type == netatom[NetWMDesktop]) {
+		if ((unsigned long)cme->data.l[0] == 0xFFFFFFFF)
+			setclienttags(c, TAGMASK);
+		else if (cme->data.l[0] >= 0 && cme->data.l[0] < LENGTH(tags))
+			setclienttags(c, 1 << cme->data.l[0]);
+		return;
+	}
 	if (cme->message_type == netatom[NetWMState]) {
 		if (cme->data.l[1] == netatom[NetWMFullscreen]
 		|| cme->data.l[2] == netatom[NetWMFullscreen])
@@ -696,6 +1364,10 @@ configurenotify(XEvent *e)
 		sw = ev->width ;
 		sh = ev->height ;
 		if (updategeom() || dirty) {
+#ifdef XINPUT2
+			if (dirty)
+				updatebarriers();
+#endif /* XINPUT2 */
 			drw_resize(drw, sw, bh);
 			updatebars();
 			for (m = mons; m; m = m->next) {
@@ -804,6 +1476,7 @@ detach(Client *c)
 
 	for (tc = &c->mon->clients; *tc && *tc != c; tc = &(*tc)->next);
 	*tc = c->next;
+	canvasdel(c);
 }
 
 void
@@ -835,6 +1508,25 @@ dirtomon(int dir)
 	return m;
 }
 
+/* Handles up to "max" queued events of one class, all of them if negative. */
+void
+dispatch(Evqueue *q, int max)
+{
+	XEvent *ev;
+
+	while (running && q->head < q->n && max--) {
+		ev = &q->ev[q->head++];
+		if (ev->type == syncevbase + XSyncAlarmNotify)
+			syncnotify(ev);
+		else if (ev->type == xkbevbase)
+			xkbnotify(ev);
+		else if (ev->type < LASTEvent && handler[ev->type])
+			handler[ev->type](ev);
+	}
+	if (q->head == q->n)
+		q->head = q->n = 0;
+}
+
 void
 drawbar(Monitor *m)
 {
@@ -843,12 +1535,26 @@ drawbar(Monitor *m)
 	int boxw = drw->fonts->h / 6 + 2;
 	uint i, occ = 0, urg = 0;
 	Client *c;
+	const char *status = stext ;
+	char geom[64];
 
+	m->bardirty = 0 ;
+	if (m->sel && m->sel->titledirty) {
+		updatetitle(m->sel);
+		titlefetches++;
+	}
+	/* Geometry of a client dragged live replaces status. */
+	if (drag.apply && drag.c && drag.c->mon == m) {
+		snprintf(geom, sizeof geom, "%dx%d+%d+%d",
+			drag.c->w, drag.c->h, drag.c->x, drag.c->y);
+		status = geom ;
+	} else if (m != selmon) /* Status is only drawn on selected monitor. */
+		status = NULL ;
 	/* Draw status first so it can be overdrawn by tags later. */
-	if (m == selmon) { /* Status is only drawn on selected monitor. */
+	if (status) {
 		drw_setscheme(drw, scheme[SchemeNorm]);
-		sw = TEXTW(stext) - lrpad + 2; /* 2px right padding. */
-		drw_text(drw, m->ww - sw, 0, sw, bh, 0, stext, 0);
+		sw = TEXTW(status) - lrpad + 2; /* 2px right padding. */
+		drw_text(drw, m->ww - sw, 0, sw, bh, 0, status, 0);
 	}
 
 	for (c = m->clients; c; c = c->next) {
@@ -866,10 +1572,15 @@ drawbar(Monitor *m)
 				m == selmon && selmon->sel && selmon->sel->tags & 1 << i,
 				urg & 1 << i);
 		x += w;
+		tagx[i] = x;
 	}
-	w = blw = TEXTW(m->ltsymbol);
+	m->barx[ClkTagBar] = x;
+	w = TEXTW(m->ltsymbol);
 	drw_setscheme(drw, scheme[SchemeNorm]);
 	x = drw_text(drw, x, 0, w, bh, lrpad / 2, m->ltsymbol, 0);
+	m->barx[ClkLtSymbol] = x;
+	m->barx[ClkWinTitle] = MAX(x, m->ww - sw);
+	m->barx[ClkStatusText] = m->ww;
 
 	if ((w = m->ww - sw - x) > bh) {
 		if (m->sel) {
@@ -894,6 +1605,52 @@ drawbars(void)
 		drawbar(m);
 }
 
+void
+drawdirtybars(void)
+{
+	Monitor *m;
+
+	for (m = mons; m; m = m->next)
+		if (m->bardirty)
+			drawbar(m);
+}
+
+/* Applies the last pointer position of a live drag. Runs at "framerate", so
+* clients get one geometry update per frame however fast the pointer moves. */
+void
+dragtick(void)
+{
+	if (!drag.c || !drag.moved)
+		return;
+	drag.moved = 0 ;
+	drag.apply(drag.c, drag.x, drag.y);
+	drag.c->mon->bardirty = 1 ;
+}
+
+/* Ends the active drag with its last event. The grab is kept when "done"
+* starts another drag, like moving a client just picked. */
+void
+enddrag(XButtonEvent *ev)
+{
+	void (*done)(XButtonEvent *ev) = drag.done ;
+
+	drag.type = 0 ;
+	if (drag.apply) {
+		settimer(dragtimer, 0, 0);
+		if (drag.c)
+			drag.c->mon->bardirty = 1 ;
+		drag.apply = NULL ;
+	}
+	done(ev);
+	if (drag.type)
+		return;
+	XUngrabPointer(dpy, CurrentTime);
+	if (drag.restore)
+		XWarpPointer(dpy, None, root, 0, 0, 0, 0, drag.px, drag.py);
+	drag.restore = 0 ;
+	drag.c = NULL ;
+}
+
 void
 enternotify(XEvent *e)
 {
@@ -928,8 +1685,39 @@ floating(Monitor *m)
 {
 	Client *c;
 	/* if( !nClients(m, IsVisible|IsTile) ) return ; */
-	for( c=nextclient(m->clients, IsTile|IsVisible) ; c ; c=nextclient(c->next, IsTile|IsVisible) )
-		resize(c, c->fx, c->fy, c->fw, c->fh, 0);
+	int x, y;
+
+	/* Clients neither in the viewport nor on screen are left off-screen. */
+	for( c=nextclient(m->clients, IsTile|IsVisible) ; c ; c=nextclient(c->next, IsTile|IsVisible) ){
+		x = c->fx - m->vx ;
+		y = c->fy - m->vy ;
+		if( intersects(m, x, y, c->fw, c->fh)
+				|| intersects(m, c->x, c->y, WIDTH(c), HEIGHT(c)) )
+			resize(c, x, y, c->fw, c->fh, 0);
+	}
+}
+
+/* Runs argv in its own session for the launcher. The child borrows the
+* parent memory until "execvp", so it only reports "errno" back through
+* "err". The parent waits for that, which only the small launcher affords. */
+int
+forkexec(char **argv)
+{
+	volatile int err = 0;
+	pid_t pid;
+
+	if ((pid = vfork()) == 0) {
+		setsid();
+		sigprocmask(SIG_SETMASK, &origmask, NULL);
+		execvp(argv[0], argv);
+		err = errno;
+		_exit(EXIT_FAILURE);
+	}
+	if (pid < 0)
+		err = errno;
+	if (err)
+		fprintf(stderr, "%s: execvp %s failed: %s\n", argv0, argv[0], strerror(err));
+	return err ? -1 : 0 ;
 }
 
 void
@@ -955,6 +1743,7 @@ focus(Client *c)
 	}
 	selmon->sel = c;
 	drawbars();
+	updatedesktops();
 }
 
 /* There are some broken focus acquiring clients needing extra handling. */
@@ -1014,6 +1803,33 @@ lowerfocused(const Arg *arg)
 	lowerclient(selmon->sel);
 }
 
+/* Each client takes half of the space the previous ones left, splitting
+* width and height by turns, so the rest dwindles to the bottom right. The
+* first split follows "mfact". */
+void
+fibonacci(const Layin *in, Plan *out)
+{
+	int i, x = in->wx, y = in->wy, w = in->ww, h = in->wh, nw, nh;
+
+	for (i = 0; i < in->n; i++) {
+		nw = w ; nh = h ;
+		if (i < in->n - 1) {
+			if (i % 2)
+				nh = h / 2 ;
+			else
+				nw = i ? w / 2 : w * in->mfact ;
+		}
+		planplace(in, out, i, x, y, nw - 2 * in->bw[i], nh - 2 * in->bw[i]);
+		if (i % 2) {
+			y += nh ;
+			h -= nh ;
+		} else {
+			x += nw ;
+			w -= nw ;
+		}
+	}
+}
+
 void
 focusstack(const Arg *arg)
 {
@@ -1031,9 +1847,13 @@ focusstack(const Arg *arg)
 	}
 	if(c){
 		focus(c);
+		/* Turns the stack page if "c" was on another one. */
+		if( c->parked )
+			arrange(selmon);
+		else
+			restack(selmon);
 		if(arg->b && (c = selmon->sel))
 			XWarpPointer(dpy, None, c->win, 0, 0, 0, 0, c->w/2, c->h/2);
-		restack(selmon);
 	}
 }
 
@@ -1106,43 +1926,116 @@ gettextprop(Window w, Atom atom, char *text, uint size)
 	return 1;
 }
 
+/* Bindings on clients are grabbed once on root, which sees the press
+* before the clients do. The pointer stays frozen until "buttonpress"
+* takes the press or replays it to a window the WM does not handle. */
+void
+grabbindings(void)
+{
+	uint i, j;
+	uint modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+
+	XUngrabButton(dpy, AnyButton, AnyModifier, root);
+	for (i = clkbuttonsoff[ClkClientWin]; i < clkbuttonsoff[ClkClientWin + 1]; i++)
+		for (j = 0; j < LENGTH(modifiers); j++)
+			XGrabButton(dpy, clkbuttons[i]->button,
+				clkbuttons[i]->mask | modifiers[j],
+				root, False, BUTTONMASK,
+				GrabModeSync, GrabModeAsync, None, None);
+}
+
+/* Columns of rows, as square as they go. Columns to the right get a row
+* more when the clients do not fill the grid. */
+void
+grid(const Layin *in, Plan *out)
+{
+	int i, cols, rows, col, row, cw, ch;
+
+	for (cols = 1; cols * cols < in->n; cols++);
+	rows = in->n / cols ;
+	for (i = col = row = 0; i < in->n; i++) {
+		if (row == 0 && col >= cols - in->n % cols)
+			rows = in->n / cols + 1 ;
+		cw = in->ww / cols ;
+		ch = in->wh / rows ;
+		planplace(in, out, i, in->wx + col * cw, in->wy + row * ch,
+			cw - 2 * in->bw[i], ch - 2 * in->bw[i]);
+		if (++row >= rows) {
+			row = 0 ;
+			col++;
+		}
+	}
+}
+
+/* Unfocused clients get a catch-all grab so that clicking them focuses.
+* It is only touched when the focus state of the client really changes. */
 void
 grabbuttons(Client *c, int focused)
 {
-	updatenumlockmask();
-	{
-		uint i, j;
-		uint modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+	if (c->catchall == !focused)
+		return;
+	if (focused)
 		XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
-		if (!focused)
-			XGrabButton(dpy, AnyButton, AnyModifier, c->win, False,
-				BUTTONMASK, GrabModeSync, GrabModeSync, None, None);
-		for (i = 0; i < LENGTH(buttons); i++)
-			if (buttons[i].click == ClkClientWin)
-				for (j = 0; j < LENGTH(modifiers); j++)
-					XGrabButton(dpy, buttons[i].button,
-						buttons[i].mask | modifiers[j],
-						c->win, False, BUTTONMASK,
-						GrabModeAsync, GrabModeSync, None, None);
-	}
+	else
+		XGrabButton(dpy, AnyButton, AnyModifier, c->win, False,
+			BUTTONMASK, GrabModeSync, GrabModeSync, None, None);
+	c->catchall = !focused;
 }
 
 void
 grabkeys(void)
 {
-	updatenumlockmask();
-	{
-		uint i, j;
-		uint modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
-		KeyCode code;
+	uint i, j;
+	uint modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+	KeyCode code;
+
+	XUngrabKey(dpy, AnyKey, AnyModifier, root);
+	for (i = 0; i < LENGTH(keys); i++)
+		if ((code = XKeysymToKeycode(dpy, keys[i].keysym)))
+			for (j = 0; j < LENGTH(modifiers); j++)
+				XGrabKey(dpy, code, keys[i].mod | modifiers[j], root,
+					True, GrabModeAsync, GrabModeAsync);
+}
+
+/* Sends "c" to the monitor its geometry is mostly on and focuses there. */
+void
+handovermon(Client *c)
+{
+	Monitor *m;
+
+	if ((m = recttomon(c->x, c->y, c->w, c->h)) == c->mon)
+		return;
+	sendmon(c, m);
+	selmon = m ;
+	focus(NULL);
+}
 
-		XUngrabKey(dpy, AnyKey, AnyModifier, root);
-		for (i = 0; i < LENGTH(keys); i++)
-			if ((code = XKeysymToKeycode(dpy, keys[i].keysym)))
-				for (j = 0; j < LENGTH(modifiers); j++)
-					XGrabKey(dpy, code, keys[i].mod | modifiers[j], root,
-						True, GrabModeAsync, GrabModeAsync);
+/* Errors of the requests issued between "ignorestart" and "ignoreend" are
+* dropped by "xerror", so requests to windows that may be gone need neither a
+* server grab nor a round trip. Ranges the server is done with are reused. */
+void
+ignorestart(void)
+{
+	unsigned long done = LastKnownRequestProcessed(dpy);
+	int i, n;
+
+	for (i = n = 0; i < nignores; i++)
+		if (ignores[i].last > done)
+			ignores[n++] = ignores[i];
+	nignores = n ;
+	if (nignores == LENGTH(ignores)) {
+		XSync(dpy, False);
+		nignores = 0 ;
 	}
+	ignores[nignores].first = NextRequest(dpy);
+}
+
+void
+ignoreend(void)
+{
+	ignores[nignores].last = NextRequest(dpy) - 1;
+	if (ignores[nignores].last >= ignores[nignores].first)
+		nignores++;
 }
 
 void
@@ -1172,6 +2065,28 @@ incnmaster(const Arg *arg)
 	arrange(selmon);
 }
 
+/* Whether the rectangle overlaps the window area of "m". Unlike INTERSECT
+* on WIDTH and HEIGHT it stays signed, so rectangles left of or above the
+* monitor do not wrap into huge areas. */
+int
+intersects(Monitor *m, int x, int y, int w, int h)
+{
+	return x < m->wx + m->ww && m->wx < x + w
+		&& y < m->wy + m->wh && m->wy < y + h;
+}
+
+int
+isbound(uint click, uint button, uint state)
+{
+	uint i;
+
+	for (i = clkbuttonsoff[click]; i < clkbuttonsoff[click + 1]; i++)
+		if (clkbuttons[i]->button == button
+				&& CLEANMASK(clkbuttons[i]->mask) == CLEANMASK(state))
+			return 1;
+	return 0;
+}
+
 #ifdef XINERAMA
 static
 int
@@ -1206,14 +2121,11 @@ killcurclient(const Arg *arg)
 {
 	if (!selmon->sel)
 		return;
-	if (!sendevent(selmon->sel, wmatom[WMDelete])) {
-		XGrabServer(dpy);
-		XSetErrorHandler(xerrordummy);
+	if (!sendevent(selmon->sel, WMDelete)) {
+		ignorestart();
 		XSetCloseDownMode(dpy, DestroyAll);
 		XKillClient(dpy, selmon->sel->win);
-		XSync(dpy, False);
-		XSetErrorHandler(xerror);
-		XUngrabServer(dpy);
+		ignoreend();
 	}
 }
 
@@ -1232,7 +2144,7 @@ manage(Window w, XWindowAttributes *wa)
 	c->w = c->freew = c->oldw = c->fw = wa->width ;
 	c->h = c->freeh = c->oldh = c->fh = wa->height ;
 	c->oldbw = wa->border_width ;
-
+	c->desktop = -1 ;
 
 	updatetitle(c);
 	if( XGetTransientForHint(dpy, w, &trans) && (t = wintoclient(trans)) ){
@@ -1242,6 +2154,8 @@ manage(Window w, XWindowAttributes *wa)
 		c->mon = selmon ;
 		applyrules(c);
 	}
+	c->fx += c->mon->vx ;
+	c->fy += c->mon->vy ;
 
 	if (c->x + WIDTH(c) > c->mon->mx + c->mon->mw)
 		c->x = c->mon->mx + c->mon->mw - WIDTH(c);
@@ -1257,9 +2171,11 @@ manage(Window w, XWindowAttributes *wa)
 	XConfigureWindow(dpy, w, CWBorderWidth, &wc);
 	XSetWindowBorder(dpy, w, scheme[SchemeNorm][ColBorder].pixel);
 	configure(c); /* Propagates border_width, if size doesn't change. */
+	c->wtype = getatomprop(c, netatom[NetWMWindowType]);
 	updatewindowtype(c);
 	updatesizehints(c);
 	updatewmhints(c);
+	updateprotocols(c);
 	XSelectInput(dpy, w, EnterWindowMask|FocusChangeMask|PropertyChangeMask|StructureNotifyMask);
 	grabbuttons(c, 0);
 	if( c->isfree ){
@@ -1269,8 +2185,7 @@ manage(Window w, XWindowAttributes *wa)
 	}
 	attach(c);
 	attachstack(c);
-	XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend,
-		(unsigned char *) &(c->win), 1 );
+	updateclientlist();
 	XMoveResizeWindow(dpy, c->win, c->x + 2 * sw, c->y, c->w, c->h); /* Some windows require this. */
 	setclientstate(c, NormalState);
 	if (c->mon == selmon) unfocus(selmon->sel, 0) ;
@@ -1286,16 +2201,96 @@ mappingnotify(XEvent *e)
 	XMappingEvent *ev = &e->xmapping ;
 
 	XRefreshKeyboardMapping(ev);
-	if (ev->request == MappingKeyboard){
+	if (ev->request == MappingKeyboard || ev->request == MappingModifier){
+		updatenumlockmask();
 		grabkeys();
+		grabbindings();
 	}
 }
 
-void
-maprequest(XEvent *e)
+typedef struct {
+	char *s;
+	size_t len, size;
+} Resbuf ;
+
+static void
+resbufadd(Resbuf *b, const char *s, size_t n)
 {
-	static XWindowAttributes wa;
-	XMapRequestEvent *ev = &e->xmaprequest ;
+	if (b->len + n + 1 > b->size) {
+		b->size = MAX(2 * b->size, b->len + n + 1);
+		if (!(b->s = realloc(b->s, b->size)))
+			die("realloc:");
+	}
+	memcpy(b->s + b->len, s, n);
+	b->len += n;
+	b->s[b->len] = '\0';
+}
+
+/* Writes an entry back in the "name:\tvalue" form "xrdb" uses. The value
+* is escaped as "XrmPutFileDatabase" does, so it reads back the same as the
+* text "xrdb" copies from the file. */
+static Bool
+resbufentry(XrmDatabase *db, XrmBindingList bindings, XrmQuarkList quarks,
+	XrmRepresentation *type, XrmValue *value, XPointer closure)
+{
+	Resbuf *b = (Resbuf *)closure ;
+	const char *q, *v;
+	char oct[5];
+	uint i;
+
+	for (i = 0; quarks[i] != NULLQUARK; i++) {
+		if (i || bindings[i] == XrmBindLoosely)
+			resbufadd(b, bindings[i] == XrmBindLoosely ? "*" : ".", 1);
+		q = XrmQuarkToString(quarks[i]);
+		resbufadd(b, q, strlen(q));
+	}
+	resbufadd(b, ":\t", 2);
+	v = value->addr ;
+	if (v && (*v == ' ' || *v == '\t'))
+		resbufadd(b, "\\", 1);
+	for (; v && *v; v++)
+		if (*v == '\n')
+			resbufadd(b, "\\n", 2);
+		else if (*v == '\\')
+			resbufadd(b, "\\\\", 2);
+		else if (((unsigned char)*v < ' ' && *v != '\t')
+				|| ((unsigned char)*v >= 0x7f && (unsigned char)*v < 0xa0)) {
+			snprintf(oct, sizeof oct, "\\%03o", (unsigned char)*v);
+			resbufadd(b, oct, 4);
+		} else
+			resbufadd(b, v, 1);
+	resbufadd(b, "\n", 1);
+	return False;
+}
+
+/* Does "xrdb -merge" without "cpp": file entries win over the ones already
+* in RESOURCE_MANAGER, which is then replaced by the merged database. */
+void
+mergeresources(const char *path)
+{
+	XrmDatabase db;
+	XrmQuark empty = NULLQUARK;
+	Resbuf b = {0};
+	char *s;
+
+	XrmInitialize();
+	if (!(db = XrmGetFileDatabase(path)))
+		return;
+	if ((s = XResourceManagerString(dpy)))
+		XrmCombineDatabase(XrmGetStringDatabase(s), &db, False);
+	XrmEnumerateDatabase(db, &empty, &empty, XrmEnumAllLevels, resbufentry, (XPointer)&b);
+	if (b.s)
+		XChangeProperty(dpy, root, XA_RESOURCE_MANAGER, XA_STRING, 8,
+			PropModeReplace, (unsigned char *)b.s, b.len);
+	free(b.s);
+	XrmDestroyDatabase(db);
+}
+
+void
+maprequest(XEvent *e)
+{
+	static XWindowAttributes wa;
+	XMapRequestEvent *ev = &e->xmaprequest ;
 
 	if (!XGetWindowAttributes(dpy, ev->window, &wa) || wa.override_redirect){
 		return;
@@ -1305,21 +2300,20 @@ maprequest(XEvent *e)
 }
 
 void
-monocle(Monitor *m)
+monocle(const Layin *in, Plan *out)
 {
-	uint n = 0;
-	Client *c;
+	int i;
 
-	for (c = m->clients; c; c = c->next){
-		if (ISVISIBLE(c)){ n++ ; }
-	}
-	if (n > 0){ /* Override layout symbol. */
-		snprintf(m->ltsymbol, sizeof m->ltsymbol, "[%d]", n);
-	}
-	for (c = nextclient(m->clients, IsTile|IsVisible); c;
-			 c = nextclient(c->next, IsTile|IsVisible) ){
-		resize(c, m->wx, m->wy, m->ww - 2 * c->bw, m->wh - 2 * c->bw, 0);
-	}
+	if (in->nvisible > 0) /* Override layout symbol. */
+		snprintf(out->symbol, sizeof out->symbol, "[%d]", in->nvisible);
+	/* Only the top client can be seen, the others are parked as they are
+	* and get their geometry once focused. */
+	for (i = 0; i < in->n; i++)
+		if (i == in->top)
+			planplace(in, out, i, in->wx, in->wy,
+				in->ww - 2 * in->bw[i], in->wh - 2 * in->bw[i]);
+		else
+			out->park[i] = 1 ;
 }
 
 void
@@ -1330,6 +2324,12 @@ motionnotify(XEvent *e)
 	XMotionEvent *ev = &e->xmotion ;
 
 	if( ev->window != root ) return;
+	if( drag.type ){
+		drag.x = ev->x_root ; drag.y = ev->y_root ;
+		drag.moved = 1 ;
+		sidehandle(ev->x_root, ev->y_root);
+		return;
+	}
 	if ((m = recttomon(ev->x_root, ev->y_root, 1, 1)) != mon && mon) {
 		unfocus(selmon->sel, 1);
 		selmon = m ;
@@ -1341,10 +2341,9 @@ motionnotify(XEvent *e)
 void
 movemouse(const Arg *arg)
 {
-	int x, y, nx, ny;
+	int x, y;
 	Client *c;
 	Monitor *m = selmon ;
-	XEvent ev;
 
 	if ( !(c = m->sel) || c->isfullscreen) return; 
 
@@ -1357,46 +2356,98 @@ movemouse(const Arg *arg)
 
 	if (!getrootptr(&x, &y)) return;
 
-	waitmouse(&ev, ButtonRelease);
-	nx = ev.xbutton.x ; ny = ev.xbutton.y ;
+	if (startdrag(ButtonRelease, CurMove, movedone))
+		livedragc(c, moveapply);
+}
+
+void
+moveapply(Client *c, int x, int y)
+{
+	Monitor *m = c->mon ;
+	int freed = 0 ;
 
 	if ( !c->isfree && m->lt != &layouts[LayoutFloating] )
-		c->isfree = 1 ;
+		c->isfree = freed = 1 ;
 
-	resize(c, nx, ny, c->w, c->h, 1);
+	resize(c, x, y, c->w, c->h, 1);
 
-	if(m->lt !=&layouts[LayoutFloating] && c->isfree)
+	/* The rest is arranged when "c" leaves it, not on every frame. */
+	if(freed)
 		arrange(m);
+	handovermon(c);
+}
 
-	XUngrabPointer(dpy, CurrentTime);
+void
+movedone(XButtonEvent *ev)
+{
+	Client *c = drag.c ;
+
+	if (!c) return;
+	moveapply(c, ev->x_root, ev->y_root);
+	if (c->isfree && c->mon->lt != &layouts[LayoutFloating])
+		arrange(c->mon);
 }
 
 void
 moveclick(const Arg *arg)
 {
 	int x, y;
+
+	if (!getrootptr(&x, &y) || !startdrag(ButtonPress, CurMove, movepicked))
+		return;
+	drag.px = x ; drag.py = y ;
+	drag.restore = 1 ;
+}
+
+void
+movepicked(XButtonEvent *ev)
+{
 	Client *c;
-	XEvent ev;
-	getrootptr(&x, &y);
-	//waitmouse(&ev, ButtonRelease);
-	if(! (c = clientclick(0, 1)) ) return ;
+
+	if(! (c = pickedclient(ev)) ) return ;
 	focus(c);
 	movemouse(0);
-	XWarpPointer(dpy, None, root, 0, 0, 0, 0, x, y);
+}
+
+/* Drags "c", following the pointer with "apply" if "livedrag" is set. */
+void
+livedragc(Client *c, void (*apply)(Client *c, int x, int y))
+{
+	drag.c = c ;
+	if (!livedrag)
+		return;
+	drag.apply = apply ;
+	settimer(dragtimer, 1000 / framerate, 1);
 }
 
 void
 killclick(const Arg *arg)
 {
 	int x, y;
+
+	if (!getrootptr(&x, &y) || !startdrag(ButtonPress, CurMove, killpicked))
+		return;
+	drag.px = x ; drag.py = y ;
+	drag.restore = 1 ;
+}
+
+void
+killpicked(XButtonEvent *ev)
+{
 	Client *c;
-	XEvent ev;
-	getrootptr(&x, &y);
-	//waitmouse(&ev, ButtonRelease);
-	if(! (c = clientclick(0, 1)) ) return ;
+
+	if(! (c = pickedclient(ev)) ) return ;
 	focus(c);
 	killcurclient(0);
-	XWarpPointer(dpy, None, root, 0, 0, 0, 0, x, y);
+}
+
+long
+nowms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
 Client *
@@ -1437,6 +2488,91 @@ nextlayout(const Arg *arg)
 	setlayout(&varg);
 }
 
+/* Pages the stack area at most "stackpage" clients at a time, the page of
+* the selected client if it is in the stack. Returns how many stack clients
+* are shown, the "first" of them by index, and names the page in the layout
+* symbol. */
+int
+pagestack(const Layin *in, Plan *out, int *first)
+{
+	int i, ns, pages;
+
+	*first = in->nmaster ;
+	if (in->n <= in->nmaster)
+		return 0;
+	ns = in->n - in->nmaster ;
+	if (!stackpage || ns <= stackpage) {
+		out->page = 0 ;
+		return ns;
+	}
+	pages = (ns + stackpage - 1) / stackpage ;
+	if ((i = in->sel) >= in->nmaster)
+		out->page = (i - in->nmaster) / stackpage ;
+	out->page = MIN(out->page, pages - 1);
+	*first += out->page * stackpage ;
+	snprintf(out->symbol, sizeof out->symbol, "%s %d/%d", in->symbol, out->page + 1, pages);
+	return MIN(stackpage, ns - out->page * stackpage);
+}
+
+/* Moves "c" out of sight keeping its size, so it is not reconfigured and
+* does not reflow while the layout does not show it. */
+void
+park(Client *c)
+{
+	if (c->parked)
+		return;
+	c->parked = 1 ;
+	XMoveWindow(dpy, c->win, WIDTH(c) * -2, c->y);
+}
+
+/* Size client "i" is given for "w" and "h" by "applysizehints", so the
+* clients stacked after it start where it really ends. */
+void
+planfit(const Layin *in, int i, int *w, int *h)
+{
+	int baseismin;
+
+	*w = MAX(*w, in->minsize);
+	*h = MAX(*h, in->minsize);
+	if (!in->hints)
+		return;
+	/* See last two sentences in "ICCCM 4.1.2.3". */
+	baseismin = in->basew[i] == in->minw[i] && in->baseh[i] == in->minh[i] ;
+	if (!baseismin) {
+		*w -= in->basew[i] ;
+		*h -= in->baseh[i] ;
+	}
+	if (in->mina[i] > 0 && in->maxa[i] > 0) {
+		if (in->maxa[i] < (float)*w / *h)
+			*w = *h * in->maxa[i] + 0.5 ;
+		else if (in->mina[i] < (float)*h / *w)
+			*h = *w * in->mina[i] + 0.5 ;
+	}
+	if (baseismin) {
+		*w -= in->basew[i] ;
+		*h -= in->baseh[i] ;
+	}
+	/* Unsigned as the hints of "Client" are. */
+	if (in->incw[i])
+		*w -= (uint)*w % in->incw[i] ;
+	if (in->inch[i])
+		*h -= (uint)*h % in->inch[i] ;
+	*w = MAX((uint)(*w + in->basew[i]), (uint)in->minw[i]);
+	*h = MAX((uint)(*h + in->baseh[i]), (uint)in->minh[i]);
+	if (in->maxw[i])
+		*w = MIN((uint)*w, (uint)in->maxw[i]);
+	if (in->maxh[i])
+		*h = MIN((uint)*h, (uint)in->maxh[i]);
+}
+
+void
+planplace(const Layin *in, Plan *out, int i, int x, int y, int w, int h)
+{
+	planfit(in, i, &w, &h);
+	out->x[i] = x ; out->y[i] = y ;
+	out->w[i] = w ; out->h[i] = h ;
+}
+
 void
 pop(Client *c)
 {
@@ -1455,9 +2591,16 @@ propertynotify(XEvent *e)
 
 	if ((ev->window == root) && (ev->atom == XA_WM_NAME))
 		updatestatus();
-	else if (ev->state == PropertyDelete)
-		return; /* Ignore. */
 	else if ((c = wintoclient(ev->window))) {
+		/* Cached properties are refetched when deleted as well. */
+		if (ev->atom == wmatom[WMProtocols])
+			updateprotocols(c);
+		else if (ev->atom == netatom[NetWMSyncRequestCounter])
+			updatesynccounter(c);
+		else if (ev->atom == XA_WM_HINTS)
+			updatewmhints(c);
+		if (ev->state == PropertyDelete)
+			return; /* Ignore. */
 		switch(ev->atom) {
 		default: break;
 		case XA_WM_TRANSIENT_FOR:
@@ -1469,20 +2612,129 @@ propertynotify(XEvent *e)
 			updatesizehints(c);
 			break;
 		case XA_WM_HINTS:
-			updatewmhints(c);
 			drawbars();
 			break;
 		}
 		if (ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName]) {
-			updatetitle(c);
+			/* Fetched by "drawbar" if the title is shown at all. */
+			c->titledirty = 1 ;
+			titlenotifies++;
 			if (c == c->mon->sel)
-				drawbar(c->mon);
+				c->mon->bardirty = 1 ;
 		}
-		if (ev->atom == netatom[NetWMWindowType])
+		if (ev->atom == netatom[NetWMWindowType]) {
+			c->wtype = getatomprop(c, netatom[NetWMWindowType]);
 			updatewindowtype(c);
+		}
 	}
 }
 
+static void
+publishwinlist(int i, Atom prop, Window *w, int n)
+{
+	if (n == nclientlist[i] && (!n || !memcmp(w, clientlist[i], n * sizeof(Window))))
+		return;
+	if (!(clientlist[i] = realloc(clientlist[i], MAX(n, 1) * sizeof(Window))))
+		die("realloc:");
+	memcpy(clientlist[i], w, n * sizeof(Window));
+	nclientlist[i] = n;
+	XChangeProperty(dpy, root, prop, XA_WINDOW, 32, PropModeReplace,
+		(unsigned char *)w, n);
+}
+
+/* Publishes the client lists if they changed. Stacking goes bottom to top
+* by the layers of "stacklayer", each in reverse focus order. */
+void
+publishclientlist(void)
+{
+	Client *c;
+	Monitor *m;
+	Window *w;
+	int n = 0, i, k, layer;
+
+	if (!clientlistdirty)
+		return;
+	clientlistdirty = 0 ;
+	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			n++;
+	w = ecalloc(MAX(n, 1), sizeof(Window));
+	i = 0;
+	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			w[i++] = c->win;
+	publishwinlist(0, netatom[NetClientList], w, n);
+
+	i = 0;
+	for (m = mons; m; m = m->next)
+		/* The focus stack is top first, so every layer is filled backwards. */
+		for (layer = StackLast - 1; layer >= 0; layer--) {
+			for (k = 0, c = m->stack; c; c = c->snext)
+				k += stacklayer(c) == layer;
+			i += k;
+			for (k = 0, c = m->stack; c; c = c->snext)
+				if (stacklayer(c) == layer)
+					w[i - ++k] = c->win;
+		}
+	publishwinlist(1, netatom[NetClientListStacking], w, i);
+	free(w);
+}
+
+/* Publishes the selected monitor's view as _NET_CURRENT_DESKTOP, the canvas
+* origin of every desktop as _NET_DESKTOP_VIEWPORT and the tags of clients
+* which changed. */
+void
+publishdesktops(void)
+{
+	static long netviewport[2 * LENGTH(tags)]; /* Last published. */
+	static int viewportset = 0 ;
+	Client *c;
+	Monitor *m;
+	long d, vp[2 * LENGTH(tags)];
+	int i;
+
+	if (!desktopsdirty)
+		return;
+	desktopsdirty = 0 ;
+	if ((d = bitid(selmon->tagset[selmon->seltags])) >= 0 && d != netdesktop) {
+		netdesktop = d ;
+		XChangeProperty(dpy, root, netatom[NetCurrentDesktop], XA_CARDINAL, 32,
+			PropModeReplace, (unsigned char *)&netdesktop, 1);
+	}
+	/* A desktop is at the origin of the monitor viewing it, or where it was
+	* last viewed. */
+	memcpy(vp, netviewport, sizeof vp);
+	for (m = mons; m; m = m->next)
+		for (i = 0; i < LENGTH(tags); i++)
+			if (m->tagset[m->seltags] & 1 << i) {
+				vp[2 * i] = m->vx ;
+				vp[2 * i + 1] = m->vy ;
+			}
+	if (!viewportset || memcmp(vp, netviewport, sizeof vp)) {
+		viewportset = 1 ;
+		memcpy(netviewport, vp, sizeof vp);
+		XChangeProperty(dpy, root, netatom[NetDesktopViewport], XA_CARDINAL, 32,
+			PropModeReplace, (unsigned char *)vp, LENGTH(vp));
+	}
+	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next) {
+			d = (c->tags & TAGMASK) == TAGMASK ? 0xFFFFFFFF : bitid(c->tags);
+			if (d == c->desktop)
+				continue;
+			c->desktop = d ;
+			XChangeProperty(dpy, c->win, netatom[NetWMDesktop], XA_CARDINAL, 32,
+				PropModeReplace, (unsigned char *)&c->desktop, 1);
+		}
+}
+
+/* Printed on exit and before a restart, which does not run "cleanup". */
+void
+printcounters(void)
+{
+	fprintf(stderr, "%s: %lu title changes, %lu fetched, %lu avoided\n", argv0,
+		titlenotifies, titlefetches, titlenotifies - titlefetches);
+}
+
 void
 quit(const Arg *arg)
 {
@@ -1507,85 +2759,139 @@ recttomon(int x, int y, int w, int h)
 void
 resize(Client *c, int x, int y, int w, int h, int interact)
 {
-	if (applysizehints(c, &x, &y, &w, &h, interact))
+	if (applysizehints(c, &x, &y, &w, &h, interact) || c->parked)
 		resizeclient(c, x, y, w, h);
 }
 
 void
 resizeclient(Client *c, int x, int y, int w, int h)
 {
-	XWindowChanges wc;
-	setWCGeometry(&wc, x, y, w, h);
+	c->parked = 0 ;
 	setGeometry(c, x, y, w, h);
 	setOldGeometry(c, x, y, w, h);
 	if( c->isfree ){
 		setFreeGeometry(c, x, y, w, h);
-		setFloatingGeometry(c, x, y, w, h);
+		setFloatingGeometry(c, x + c->mon->vx, y + c->mon->vy, w, h);
 	} else if( c->mon->lt == &layouts[LayoutFloating] )
-		setFloatingGeometry(c, x, y, w, h);
+		setFloatingGeometry(c, x + c->mon->vx, y + c->mon->vy, w, h);
+	if (c->syncsent) {
+		c->syncdeferred = 1 ;
+		return;
+	}
+	configureclient(c);
+}
+
+/* Sends the geometry of "c" to its window. Clients supporting
+* _NET_WM_SYNC_REQUEST get no other one until they have drawn it. */
+void
+configureclient(Client *c)
+{
+	XWindowChanges wc;
+
+	setWCGeometry(&wc, c->x, c->y, c->w, c->h);
 	wc.border_width = c->bw ;
+	/* Many clients leave the counter alone for a move, which would stall. */
+	if (c->synccounter && (c->w != c->syncw || c->h != c->synch))
+		syncrequest(c);
+	c->syncw = c->w ;
+	c->synch = c->h ;
 	XConfigureWindow(dpy, c->win, CWX|CWY|CWWidth|CWHeight|CWBorderWidth, &wc);
 	configure(c);
-	XSync(dpy, False);
+	if (!batchsync)
+		XSync(dpy, False);
 }
 
 void
 resizemouse(const Arg *arg)
 {
-	int nw, nh;
 	Client *c;
-	Monitor *m;
-	XEvent ev;
 
 	if (!(c = selmon->sel) || c->isfullscreen) return ;
 
 	restack(selmon);
 
-	/*if( XGrabPointer(dpy, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
-			None, cursor[CurResize]->cursor, CurrentTime) != GrabSuccess )
-		return; */
-
 	if( c->x+c->w < sw && c->y+c->h < sh )
 		XWarpPointer(dpy, None, c->win,
 			0, 0, 0, 0,
 			c->w - c->bw, c->h - c->bw);
 
-	waitmouse(&ev, ButtonRelease) ;
-	nw = MAX(1, ev.xbutton.x - c->x ) ; nh = MAX(1, ev.xbutton.y - c->y ) ;
+	if (startdrag(ButtonRelease, CurResize, resizedone))
+		livedragc(c, resizeapply);
+}
+
+void
+resizeapply(Client *c, int x, int y)
+{
+	int nw, nh, freed = 0;
+
+	nw = MAX(1, x - c->x ) ; nh = MAX(1, y - c->y ) ;
 
 	if( c->mon->wx + nw >= selmon->wx && c->mon->wx + nw <= selmon->wx + selmon->ww
 			&& c->mon->wy + nh >= selmon->wy
 			&& c->mon->wy + nh <= selmon->wy + selmon->wh )
 		if( !c->isfree && selmon->lt != &layouts[LayoutFloating] )
-			c->isfree = 1 ;
+			c->isfree = freed = 1 ;
 
 	resize(c, c->x, c->y, nw, nh, 1);
-	if( selmon->lt != &layouts[LayoutFloating] && c->isfree )
+	/* As in "moveapply", arranged once when "c" turns free. */
+	if( freed )
 		arrange(selmon);
+	handovermon(c);
+}
 
+void
+resizedone(XButtonEvent *ev)
+{
+	Client *c = drag.c ;
+	XEvent xev;
+
+	if (!c) return;
+	resizeapply(c, ev->x_root, ev->y_root);
+	if( c->isfree && c->mon->lt != &layouts[LayoutFloating] )
+		arrange(c->mon);
 	/* To prevent increasing window width and height when just clicking. */
 	XWarpPointer(dpy, None, c->win, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
 	XUngrabPointer(dpy, CurrentTime);
-	while (XCheckMaskEvent(dpy, EnterWindowMask, &ev));
-	if ((m = recttomon(c->x, c->y, c->w, c->h)) != selmon) {
-		sendmon(c, m);
-		selmon = m;
-		focus(NULL);
-	}
+	while (XCheckMaskEvent(dpy, EnterWindowMask, &xev));
 }
 
 void
 resizeclick(const Arg *arg)
 {
 	int x, y;
-	XEvent ev;
+
+	if (!getrootptr(&x, &y) || !startdrag(ButtonPress, CurMove, resizepicked))
+		return;
+	drag.px = x ; drag.py = y ;
+	drag.restore = 1 ;
+}
+
+void
+resizepicked(XButtonEvent *ev)
+{
 	Client *c;
-	getrootptr(&x, &y);
-	//waitmouse(&ev, ButtonRelease);
-	if(! (c = clientclick(0, 1)) ) return ;
+
+	if(! (c = pickedclient(ev)) ) return ;
 	focus(c);
 	resizemouse(NULL);
-	XWarpPointer(dpy, None, root, 0, 0, 0, 0, x, y);
+}
+
+/* Layer "restack" leaves "c" in: the selected client is raised when free
+* or when nothing is arranged, tiled ones go below the bar in focus order
+* and the rest it does not touch. "_NET_CLIENT_LIST_STACKING" follows it. */
+int
+stacklayer(Client *c)
+{
+	Monitor *m = c->mon ;
+
+	if (!ISVISIBLE(c) || c->parked)
+		return StackHidden;
+	if (c == m->sel && (c->isfree || !m->lt->arrange)
+			&& m->lt != &layouts[LayoutFloating])
+		return StackRaised;
+	if (c->isfree || !m->lt->arrange)
+		return StackFree;
+	return StackTiled;
 }
 
 void
@@ -1596,17 +2902,17 @@ restack(Monitor *m)
 	XWindowChanges wc;
 
 	drawbar(m);
+	updateclientlist();
 	if (!m->sel)
 		return;
-	if( (m->sel->isfree || !m->lt->arrange)
-			&& m->lt != &layouts[LayoutFloating] ){
+	if( stacklayer(m->sel) == StackRaised ){
 		raiseclient(m->sel);
 	}
 	if( m->lt->arrange ){
 		wc.stack_mode = Below;
 		wc.sibling = m->barwin;
 		for (c = m->stack; c; c = c->snext)
-			if (!c->isfree && ISVISIBLE(c)) {
+			if (stacklayer(c) == StackTiled) {
 				XConfigureWindow(dpy, c->win, CWSibling|CWStackMode, &wc);
 				wc.sibling = c->win;
 			}
@@ -1616,31 +2922,159 @@ restack(Monitor *m)
 		;
 }
 
+/* Main event loop. Sleeps in "poll" on the X connection, "sigfd" and the
+* timers, so signals and timers do not wait for the next X event. Events
+* read from X are handled by class: input, then structure, and cosmetic
+* ones in slices between the rounds. */
 void
 run(void)
 {
-	XEvent ev;
-	/* Main event loop. */
+	struct pollfd pfd[2 + LENGTH(timers)];
+	uint64_t expirations;
+	int i, busy;
+
 	XSync(dpy, False);
-	while( running && !XNextEvent(dpy, &ev) ){
-		if (handler[ev.type]){
-			handler[ev.type](&ev); /* Call handler. */
+	pfd[0].fd = ConnectionNumber(dpy);
+	pfd[1].fd = sigfd;
+	for (i = 0; i < 2 + LENGTH(timers); i++)
+		pfd[i].events = POLLIN;
+	while( running ){
+		if( XEventsQueued(dpy, QueuedAfterFlush) ){
+			/* All of the socket, input behind a storm is not left unread. */
+			do
+				queueevents();
+			while( XEventsQueued(dpy, QueuedAfterReading) );
+			dispatch(&evqueue[EvInput], -1);
+			dispatch(&evqueue[EvStructure], -1);
+		}
+		/* A slice per round, so input waits for one slice at most. */
+		dispatch(&evqueue[EvCosmetic], EVSLICE);
+		if( !running )
+			break;
+		drawdirtybars();
+		publishclientlist();
+		publishdesktops();
+		XFlush(dpy);
+		busy = evqueue[EvCosmetic].n || XEventsQueued(dpy, QueuedAlready) ;
+		for (i = 0; i < ntimers; i++)
+			pfd[2 + i].fd = timers[i].fd;
+		if( poll(pfd, 2 + ntimers, busy ? 0 : -1) < 0 ){
+			if (errno == EINTR)
+				continue;
+			die("poll:");
+		}
+		if( pfd[0].revents & (POLLERR|POLLHUP) )
+			die("%s: X connection lost", argv0);
+		if( pfd[1].revents & POLLIN )
+			readsignals();
+		for (i = 0; i < ntimers; i++)
+			if( pfd[2 + i].revents & POLLIN
+					&& read(timers[i].fd, &expirations, sizeof expirations) > 0 )
+				timers[i].func();
+	}
+}
+
+/* Moves the events Xlib has read into their class queues. */
+void
+queueevents(void)
+{
+	XEvent ev;
+	Evqueue *q;
+	int n;
+
+	for (n = XEventsQueued(dpy, QueuedAlready); n > 0; n--) {
+		XNextEvent(dpy, &ev);
+#ifdef XINPUT2
+		/* Xlib drops unclaimed event data on the next "XNextEvent". */
+		if (ev.type == GenericEvent && ev.xcookie.extension == xiopcode)
+			XGetEventData(dpy, &ev.xcookie);
+#endif /* XINPUT2 */
+		/* Extension events are structural. */
+		q = &evqueue[ev.type < LASTEvent ? evclass[ev.type] : EvStructure];
+		if (q->n == q->size && q->head) {
+			memmove(q->ev, q->ev + q->head, (q->n - q->head) * sizeof(XEvent));
+			q->n -= q->head;
+			q->head = 0;
+		}
+		if (q->n == q->size) {
+			q->size = q->size ? 2 * q->size : 256;
+			if (!(q->ev = realloc(q->ev, q->size * sizeof(XEvent))))
+				die("realloc:");
+		}
+		q->ev[q->n++] = ev;
+	}
+}
+
+void
+readsignals(void)
+{
+	struct signalfd_siginfo si;
+	Arg a;
+
+	while (read(sigfd, &si, sizeof si) == sizeof si) {
+		switch (si.ssi_signo) {
+		case SIGCHLD:
+			reap();
+			break;
+		case SIGHUP:
+		case SIGTERM:
+			a.i = si.ssi_signo == SIGHUP ;
+			quit(&a);
+			break;
 		}
 	}
 }
 
 void
-sigHup(int unused)
+reap(void)
 {
-	Arg a = {.i = 1} ;
-	quit(&a);
+	while (0 < waitpid(-1, NULL, WNOHANG));
 }
 
+/* Arms "t" to fire in "ms" milliseconds and then every "ms" if "repeat" is set.
+* Zero "ms" disarms it. */
 void
-sigTerm(int unused)
+settimer(Timer *t, long ms, int repeat)
 {
-	Arg a = {.i = 0} ;
-	quit(&a);
+	struct itimerspec its = {0};
+
+	its.it_value.tv_sec = ms / 1000;
+	its.it_value.tv_nsec = ms % 1000 * 1000000;
+	if (repeat)
+		its.it_interval = its.it_value;
+	timerfd_settime(t->fd, 0, &its, NULL);
+}
+
+/* Launcher process loop: every packet is a command line of
+* NUL-terminated arguments. Exits when the WM end is closed. */
+void
+runlauncher(int fd)
+{
+	static char buf[SPAWNMAX + 1];
+	char *argv[256], *p;
+	ssize_t n;
+	int argc;
+	struct sigaction sa = { .sa_handler = SIG_DFL, .sa_flags = SA_NOCLDWAIT } ;
+
+	/* Children are reaped by the kernel, the flag is dropped on their "execvp". */
+	close(sigfd);
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGCHLD, &sa, NULL);
+	sigprocmask(SIG_SETMASK, &origmask, NULL);
+	while ((n = recv(fd, buf, sizeof buf - 1, 0)) != 0) {
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		buf[n] = '\0';
+		for (argc = 0, p = buf; p < buf + n && argc < LENGTH(argv) - 1; p += strlen(p) + 1)
+			argv[argc++] = p;
+		argv[argc] = NULL;
+		if (argc)
+			forkexec(argv);
+	}
+	_exit(EXIT_SUCCESS);
 }
 
 void
@@ -1658,12 +3092,20 @@ setGeometry(Client *c, int x, int y, uint w, uint h)
 	c->w = w ; c->h = h ;
 }
 
+/* Floating geometry is kept in canvas coordinates, see "moveWins". */
 void
 setFloatingGeometry(Client *c, int fx, int fy, uint fw, uint fh)
 {
+	int indexed;
+
 	if(!c) return ;
+	if( c->fx == fx && c->fy == fy && c->fw == fw && c->fh == fh ) return ;
+	indexed = c->incanvas ;
+	canvasdel(c);
 	c->fx = fx ; c->fy = fy ;
 	c->fw = fw ; c->fh = fh ;
+	if( indexed )
+		canvasadd(c);
 }
 
 void
@@ -1715,6 +3157,7 @@ void
 sendmon(Client *c, Monitor *m)
 {
 	if (c->mon == m){ return; }
+	dropplans(c->mon);
 	unfocus(c, 1);
 	detach(c);
 	detachstack(c);
@@ -1726,6 +3169,14 @@ sendmon(Client *c, Monitor *m)
 	arrange(NULL);
 }
 
+void
+setclienttags(Client *c, uint tags)
+{
+	c->tags = tags ;
+	focus(NULL);
+	arrange(c->mon);
+}
+
 void
 setclientstate(Client *c, long state)
 {
@@ -1735,30 +3186,22 @@ setclientstate(Client *c, long state)
 		PropModeReplace, (unsigned char *)data, 2);
 }
 
+/* "proto" is a "wmatom" index, checked against the cached WM_PROTOCOLS. */
 int
-sendevent(Client *c, Atom proto)
+sendevent(Client *c, int proto)
 {
-	int n;
-	Atom *protocols;
-	int exists = 0;
 	XEvent ev;
 
-	if (XGetWMProtocols(dpy, c->win, &protocols, &n)) {
-		while (!exists && n--){
-			exists = protocols[n] == proto;
-		}
-		XFree(protocols);
-	}
-	if (exists) {
-		ev.type = ClientMessage ;
-		ev.xclient.window = c->win ;
-		ev.xclient.message_type = wmatom[WMProtocols] ;
-		ev.xclient.format = 32 ;
-		ev.xclient.data.l[0] = proto ;
-		ev.xclient.data.l[1] = CurrentTime ;
-		XSendEvent(dpy, c->win, False, NoEventMask, &ev);
-	}
-	return exists;
+	if (!(c->protocols & 1 << proto))
+		return 0;
+	ev.type = ClientMessage ;
+	ev.xclient.window = c->win ;
+	ev.xclient.message_type = wmatom[WMProtocols] ;
+	ev.xclient.format = 32 ;
+	ev.xclient.data.l[0] = wmatom[proto] ;
+	ev.xclient.data.l[1] = CurrentTime ;
+	XSendEvent(dpy, c->win, False, NoEventMask, &ev);
+	return 1;
 }
 
 void
@@ -1770,7 +3213,7 @@ setfocus(Client *c)
 			XA_WINDOW, 32, PropModeReplace,
 			(unsigned char *) &(c->win), 1);
 	}
-	sendevent(c, wmatom[WMTakeFocus]);
+	sendevent(c, WMTakeFocus);
 }
 
 void
@@ -1801,6 +3244,20 @@ setfullscreen(Client *c, int fullscreen)
 	}
 }
 
+void
+setkeymap(const Arg *arg)
+{
+	const Keymap *k = arg->v ;
+
+	if (!xkb)
+		return;
+	if (keymap && keymap != k)
+		prevkeymap = keymap ;
+	keymap = k ;
+	XkbLockGroup(dpy, XkbUseCoreKbd, k->group);
+	setstatus(k->name);
+}
+
 void
 togglefullscreen(const Arg *arg)
 {
@@ -1849,6 +3306,16 @@ setmfact(const Arg *arg)
 	arrange(selmon);
 }
 
+/* Sets root name without waiting for its "PropertyNotify" to redraw the bar. */
+void
+setstatus(const char *text)
+{
+	strncpy(stext, text, sizeof stext - 1);
+	stext[sizeof stext - 1] = '\0';
+	XStoreName(dpy, root, stext);
+	drawbar(selmon);
+}
+
 void
 setup(void)
 {
@@ -1856,12 +3323,33 @@ setup(void)
 	Arg arg;
 	XSetWindowAttributes wa;
 	Atom utf8string;
-
+	int di, xkbmajor = XkbMajorVersion, xkbminor = XkbMinorVersion ;
+	sigset_t sigmask;
+	long ndesktops;
+	char names[LENGTH(tags) * 32];
+	size_t n;
+
+	/* Signals are read from "sigfd" by "run". */
+	sigemptyset(&sigmask);
+	sigaddset(&sigmask, SIGCHLD);
+	sigaddset(&sigmask, SIGHUP);
+	sigaddset(&sigmask, SIGTERM);
+	sigprocmask(SIG_BLOCK, &sigmask, &origmask);
+	/* A restart execs with them unblocked, they must not leak into children anyway. */
+	sigdelset(&origmask, SIGCHLD);
+	sigdelset(&origmask, SIGHUP);
+	sigdelset(&origmask, SIGTERM);
+	if ((sigfd = signalfd(-1, &sigmask, SFD_CLOEXEC|SFD_NONBLOCK)) < 0)
+		die("signalfd:");
 	/* Clean up any zombies immediately. */
-	sigchld(0);
+	reap();
 
-	signal(SIGHUP, sigHup);
-	signal(SIGTERM, sigTerm);
+	/* Children must not inherit the X connection. */
+	fcntl(ConnectionNumber(dpy), F_SETFD, FD_CLOEXEC);
+	startlauncher();
+	dragtimer = addtimer(dragtick);
+	synctimer = addtimer(synctick);
+	scrolltimer = addtimer(scrolltick);
 
 	/* Init screen. */
 	screen = DefaultScreen(dpy);
@@ -1874,12 +3362,23 @@ setup(void)
 	lrpad = drw->fonts->h;
 	bh = drw->fonts->h + 2;
 	updategeom();
+	if ((xkb = XkbQueryExtension(dpy, &di, &xkbevbase, &di, &xkbmajor, &xkbminor)))
+		XkbSelectEventDetails(dpy, XkbUseCoreKbd, XkbStateNotify,
+			XkbGroupLockMask, XkbGroupLockMask);
+	else
+		xkbevbase = -1 ;
+	if (!XSyncQueryExtension(dpy, &syncevbase, &di) || !XSyncInitialize(dpy, &di, &di))
+		syncevbase = -1 ;
+#ifdef XINPUT2
+	setupxi();
+#endif /* XINPUT2 */
 	/* Init atoms. */
 	utf8string = XInternAtom(dpy, "UTF8_STRING", False);
 	wmatom[WMProtocols] = XInternAtom(dpy, "WM_PROTOCOLS", False);
 	wmatom[WMDelete] = XInternAtom(dpy, "WM_DELETE_WINDOW", False);
 	wmatom[WMState] = XInternAtom(dpy, "WM_STATE", False);
 	wmatom[WMTakeFocus] = XInternAtom(dpy, "WM_TAKE_FOCUS", False);
+	wmatom[WMSyncRequest] = XInternAtom(dpy, "_NET_WM_SYNC_REQUEST", False);
 	netatom[NetActiveWindow] = XInternAtom(dpy, "_NET_ACTIVE_WINDOW", False);
 	netatom[NetSupported] = XInternAtom(dpy, "_NET_SUPPORTED", False);
 	netatom[NetWMName] = XInternAtom(dpy, "_NET_WM_NAME", False);
@@ -1889,6 +3388,13 @@ setup(void)
 	netatom[NetWMWindowType] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False);
 	netatom[NetWMWindowTypeDialog] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG", False);
 	netatom[NetClientList] = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
+	netatom[NetClientListStacking] = XInternAtom(dpy, "_NET_CLIENT_LIST_STACKING", False);
+	netatom[NetNumberOfDesktops] = XInternAtom(dpy, "_NET_NUMBER_OF_DESKTOPS", False);
+	netatom[NetCurrentDesktop] = XInternAtom(dpy, "_NET_CURRENT_DESKTOP", False);
+	netatom[NetDesktopNames] = XInternAtom(dpy, "_NET_DESKTOP_NAMES", False);
+	netatom[NetWMDesktop] = XInternAtom(dpy, "_NET_WM_DESKTOP", False);
+	netatom[NetDesktopViewport] = XInternAtom(dpy, "_NET_DESKTOP_VIEWPORT", False);
+	netatom[NetWMSyncRequestCounter] = XInternAtom(dpy, "_NET_WM_SYNC_REQUEST_COUNTER", False);
 	/* Init cursors. */
 	cursor[CurNormal] = drw_cur_create(drw, XC_left_ptr) ;
 	cursor[CurResize] = drw_cur_create(drw, XC_sizing) ;
@@ -1900,6 +3406,7 @@ setup(void)
 	/* Init bars. */
 	updatebars();
 	updatestatus();
+	startup();
 	/* Supporting window for NetWMCheck. */
 	wmcheckwin = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
 	XChangeProperty(dpy, wmcheckwin, netatom[NetWMCheck], XA_WINDOW, 32,
@@ -1911,7 +3418,21 @@ setup(void)
 	/* EWMH support per view. */
 	XChangeProperty(dpy, root, netatom[NetSupported], XA_ATOM, 32,
 		PropModeReplace, (unsigned char *) netatom, NetLast);
+	XChangeProperty(dpy, root, netatom[NetSupported], XA_ATOM, 32,
+		PropModeAppend, (unsigned char *) &wmatom[WMSyncRequest], 1);
 	XDeleteProperty(dpy, root, netatom[NetClientList]);
+	XDeleteProperty(dpy, root, netatom[NetClientListStacking]);
+	/* Tags are desktops for pagers. */
+	ndesktops = LENGTH(tags);
+	XChangeProperty(dpy, root, netatom[NetNumberOfDesktops], XA_CARDINAL, 32,
+		PropModeReplace, (unsigned char *) &ndesktops, 1);
+	for (i = 0, n = 0; i < LENGTH(tags); i++) {
+		snprintf(names + n, sizeof names - n, "%s", tags[i]);
+		n = MIN(n + strlen(tags[i]) + 1, sizeof names);
+	}
+	XChangeProperty(dpy, root, netatom[NetDesktopNames], utf8string, 8,
+		PropModeReplace, (unsigned char *) names, n);
+	updatedesktops();
 	/* Select events. */
 	wa.cursor = cursor[CurNormal]->cursor;
 	wa.event_mask = SubstructureRedirectMask|SubstructureNotifyMask
@@ -1919,24 +3440,49 @@ setup(void)
 		|LeaveWindowMask|StructureNotifyMask|PropertyChangeMask;
 	XChangeWindowAttributes(dpy, root, CWEventMask|CWCursor, &wa);
 	XSelectInput(dpy, root, wa.event_mask);
+	updatenumlockmask();
 	grabkeys();
+	setupbuttons();
+	grabbindings();
 	arg.v = &layouts[setup_layouts[0].lt] ;
 	setlayout(&arg);
 	focus(NULL);
 }
 
+/* Sorts "buttons" into per click tables so "buttonpress" does not
+* have to walk all of them on every click. */
+void
+setupbuttons(void)
+{
+	uint i, j, n[ClkLast] = {0};
+	const Button *b;
+
+	for (i = 0; i < LENGTH(buttons); i++)
+		n[buttons[i].click]++;
+	for (i = 0; i < ClkLast; i++) {
+		clkbuttonsoff[i + 1] = clkbuttonsoff[i] + n[i];
+		n[i] = 0;
+	}
+	for (i = 0; i < LENGTH(buttons); i++) {
+		b = &buttons[i];
+		/* Stable insertion by button, so bindings still fire in config order. */
+		for (j = clkbuttonsoff[b->click] + n[b->click]++; j > clkbuttonsoff[b->click]
+				&& clkbuttons[j - 1]->button > b->button; j--)
+			clkbuttons[j] = clkbuttons[j - 1];
+		clkbuttons[j] = b;
+	}
+}
 
 void
 seturgent(Client *c, int urg)
 {
-	XWMHints *wmh;
-
 	c->isurgent = urg;
-	if (!(wmh = XGetWMHints(dpy, c->win)))
+	/* The cache follows WM_HINTS through its "PropertyNotify", so focusing
+	* an urgent client does not wait for the server. */
+	if (!c->haswmh || !(c->wmh.flags & XUrgencyHint) == !urg)
 		return;
-	wmh->flags = urg ? (wmh->flags | XUrgencyHint) : (wmh->flags & ~XUrgencyHint);
-	XSetWMHints(dpy, c->win, wmh);
-	XFree(wmh);
+	c->wmh.flags = urg ? (c->wmh.flags | XUrgencyHint) : (c->wmh.flags & ~XUrgencyHint);
+	XSetWMHints(dpy, c->win, &c->wmh);
 }
 
 void
@@ -1945,8 +3491,9 @@ showhide(Client *c)
 	if (!c)
 		return;
 	if (ISVISIBLE(c)) {
-		/* Show clients top down. */
-		XMoveWindow(dpy, c->win, c->x, c->y);
+		/* Show clients top down, parked ones wait for their "resize". */
+		if (!c->parked)
+			XMoveWindow(dpy, c->win, c->x, c->y);
 		if ((!c->mon->lt->arrange || c->isfree) && !c->isfullscreen)
 			resize(c, c->x, c->y, c->w, c->h, 0);
 		showhide(c->snext);
@@ -1957,40 +3504,207 @@ showhide(Client *c)
 	}
 }
 
-void
-sigchld(int unused)
+/* Rounds the master area "size" down to the size increments the master
+* clients share, so it only moves when their cell grid changes: a few
+* pixels of "mfact" then neither reconfigure nor reflow terminals. Masters
+* with different increments or base sizes get the area unchanged. */
+int
+snapsplit(const Layin *in, int size, int horizontal)
 {
-	if (signal(SIGCHLD, sigchld) == SIG_ERR)
-		die("%s: can't install SIGCHLD handler", argv0);
-	while (0 < waitpid(-1, NULL, WNOHANG));
+	int i, inc, base;
+	const int *incs = horizontal ? in->incw : in->inch ;
+	const int *bases = horizontal ? in->basew : in->baseh ;
+
+	if (!in->hints || (inc = incs[0]) <= 1)
+		return size;
+	base = bases[0] ;
+	for (i = 1; i < MIN(in->n, in->nmaster); i++)
+		if (incs[i] != inc || bases[i] != base || in->bw[i] != in->bw[0])
+			return size;
+	if (size < base + 2 * in->bw[0] + inc)
+		return size;
+	return size - (size - base - 2 * in->bw[0]) % inc;
 }
 
 void
 spawn(const Arg *arg)
 {
+	static char buf[SPAWNMAX];
+	char **argv = (char **)arg->v ;
+	size_t n, len = 0;
+
 	if( arg->v == runcmd ){
 		menumon[0] = '0' + selmon->num ;
 	}
-	if( fork() == 0 ){
-		if(dpy){
-			close(ConnectionNumber(dpy));
+	if( launcherfd >= 0 ){
+		for( ; *argv ; ++argv ){
+			if( len + (n = strlen(*argv) + 1) > sizeof buf )
+				break;
+			memcpy(buf + len, *argv, n);
+			len += n ;
 		}
+		if( !*argv && send(launcherfd, buf, len, MSG_NOSIGNAL) == len )
+			return;
+		/* Launcher is gone or the command is too long, do it here. */
+		if( !*argv ){
+			close(launcherfd);
+			launcherfd = -1 ;
+		}
+		argv = (char **)arg->v ;
+	}
+	/* Plain "fork" here: "vfork" would stop the WM until the child execs. */
+	if( fork() == 0 ){
 		setsid();
-		execvp(((char **)arg->v)[0], (char **)arg->v);
-		fprintf(stderr, "%s: execvp %s", argv0, ((char **)arg->v)[0]);
-		perror(" failed");
-		exit(EXIT_SUCCESS);
+		sigprocmask(SIG_SETMASK, &origmask, NULL);
+		execvp(argv[0], argv);
+		fprintf(stderr, "%s: execvp %s failed: %s\n", argv0, argv[0], strerror(errno));
+		_exit(EXIT_FAILURE);
 	}
 }
 
+/* Forks the launcher while the WM is still small. "spawn" then only
+* writes the command to it instead of forking the WM. */
 void
-tag(const Arg *arg)
+startlauncher(void)
 {
-	if (selmon->sel && arg->ui & TAGMASK) {
-		selmon->sel->tags = arg->ui & TAGMASK;
-		focus(NULL);
-		arrange(selmon);
+	int sv[2];
+
+	if (!uselauncher)
+		return;
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, sv) < 0) {
+		perror("socketpair");
+		return;
+	}
+	switch (fork()) {
+	case -1:
+		perror("fork");
+		close(sv[0]);
+		close(sv[1]);
+		return;
+	case 0:
+		close(ConnectionNumber(dpy));
+		close(sv[0]);
+		runlauncher(sv[1]);
+	}
+	close(sv[1]);
+	launcherfd = sv[0];
+}
+
+/* Does what "setxkbmap", "xset r rate", "xrdb -merge" and "xsetroot" did
+* from "rccmd", without opening a connection for each of them. */
+void
+startup(void)
+{
+	char buf[sizeof stext];
+	const char *home;
+	struct passwd *pw;
+	Arg a = {.v = startkeymap} ;
+	Clr bg;
+	XkbComponentNamesRec names;
+	XkbDescPtr desc;
+	uint need = XkbGBN_AllComponentsMask & ~XkbGBN_GeometryMask ;
+
+	if (xkb) {
+		/* Compiled by the server once, layouts are switched by group. */
+		names = xkbnames;
+		if ((desc = XkbGetKeyboardByName(dpy, XkbUseCoreKbd, &names, need, need, True)))
+			XkbFreeKeyboard(desc, XkbAllComponentsMask, True);
+		else
+			fprintf(stderr, "%s: can't load keymap\n", argv0);
+		XkbSetAutoRepeatRate(dpy, XkbUseCoreKbd, repeatdelay, 1000 / repeatrate);
+	}
+	setkeymap(&a);
+	if ((home = getenv("HOME"))) {
+		snprintf(buf, sizeof buf, "%s/%s", home, xresources);
+		mergeresources(buf);
 	}
+	drw_clr_create(drw, &bg, rootcolor);
+	XSetWindowBackground(dpy, root, bg.pixel);
+	XftColorFree(dpy, DefaultVisual(dpy, screen), DefaultColormap(dpy, screen), &bg);
+	XClearWindow(dpy, root);
+	pw = getpwuid(geteuid());
+	snprintf(buf, sizeof buf, "%s %s", startstatus, pw ? pw->pw_name : "");
+	setstatus(buf);
+}
+
+/* Client "c" has drawn the size asked for or is late: the geometry it missed
+* meanwhile is sent now. */
+void
+syncdone(Client *c)
+{
+	if (!c->syncsent)
+		return;
+	c->syncsent = 0 ;
+	if (!--syncwaiting)
+		settimer(synctimer, 0, 0);
+	if (c->syncdeferred) {
+		c->syncdeferred = 0 ;
+		configureclient(c);
+	}
+}
+
+void
+syncnotify(XEvent *e)
+{
+	XSyncAlarmNotifyEvent *ev = (XSyncAlarmNotifyEvent *)e;
+	Monitor *m;
+	Client *c;
+
+	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			if (c->syncalarm == ev->alarm) {
+				if (XSyncValueGreaterOrEqual(ev->counter_value, c->syncvalue))
+					syncdone(c);
+				return;
+			}
+}
+
+/* Asks "c" to bump its counter once it has drawn the next configure. */
+void
+syncrequest(Client *c)
+{
+	XEvent ev;
+	XSyncValue one;
+	XSyncAlarmAttributes aa;
+	Bool overflow;
+
+	XSyncIntToValue(&one, 1);
+	XSyncValueAdd(&c->syncvalue, c->syncvalue, one, &overflow);
+	ev.type = ClientMessage ;
+	ev.xclient.window = c->win ;
+	ev.xclient.message_type = wmatom[WMProtocols] ;
+	ev.xclient.format = 32 ;
+	ev.xclient.data.l[0] = wmatom[WMSyncRequest] ;
+	ev.xclient.data.l[1] = CurrentTime ;
+	ev.xclient.data.l[2] = XSyncValueLow32(c->syncvalue) ;
+	ev.xclient.data.l[3] = XSyncValueHigh32(c->syncvalue) ;
+	ev.xclient.data.l[4] = 0 ;
+	XSendEvent(dpy, c->win, False, NoEventMask, &ev);
+	aa.trigger.wait_value = c->syncvalue ;
+	XSyncChangeAlarm(dpy, c->syncalarm, XSyncCAValue, &aa);
+	if (!c->syncsent && !syncwaiting++)
+		settimer(synctimer, synctimeout, 1);
+	c->syncsent = nowms();
+}
+
+void
+synctick(void)
+{
+	long now = nowms();
+	Monitor *m;
+	Client *c;
+
+	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			if (c->syncsent && now - c->syncsent >= synctimeout)
+				syncdone(c);
+}
+
+void
+tag(const Arg *arg)
+{
+	if (selmon->sel && arg->ui & TAGMASK)
+		setclienttags(selmon->sel, arg->ui & TAGMASK);
 }
 
 void
@@ -2001,22 +3715,64 @@ tagmon(const Arg *arg)
 	sendmon(selmon->sel, dirtomon(arg->i));
 }
 
+/* Scrolls the canvas of "m", at once or adding to the scroll "scrolltick"
+* animates. A push from a screen edge is dropped while the previous one is
+* still animated, the pointer only leaves the edge with it. */
 void
 scrolldesk(Monitor *m, int dx, int dy, int warpptr)
 {
-	int x, y;
 	if(m->lt != &layouts[LayoutFloating] || nmons > 1){ return ; }
+	if( !smoothscroll ){
+		scrollby(m, dx, dy, warpptr);
+		return;
+	}
+	if( warpptr && m->swarp && (m->sdx || m->sdy) )
+		return;
+	if( !m->sdx && !m->sdy )
+		settimer(scrolltimer, 1000 / framerate, 1);
+	m->sdx += dx ;
+	m->sdy += dy ;
+	m->swarp = warpptr ;
+}
+
+void
+scrollby(Monitor *m, int dx, int dy, int warpptr)
+{
 	if( warpptr ){
-		/* Move pointer with windows. */
-		if( !getrootptr(&x, &y) ) return;
+		/* Move pointer with windows, relative to where it is. */
 		moveWins(m, dx, dy);
-		XWarpPointer(dpy, None, root, 0, 0, 0, 0, x+dx, y+dy);
+		XWarpPointer(dpy, None, None, 0, 0, 0, 0, dx, dy);
 	}else{
 		moveWins(m, dx, dy);
 		XRaiseWindow(dpy, m->barwin);
 	}
 }
 
+/* Frame of smooth scrolling: every monitor scrolls a part of what is left. */
+void
+scrolltick(void)
+{
+	Monitor *m;
+	int dx, dy, busy = 0 ;
+
+	for (m = mons; m; m = m->next) {
+		if (m->lt != &layouts[LayoutFloating])
+			m->sdx = m->sdy = 0 ;
+		if (!m->sdx && !m->sdy)
+			continue;
+		if (!(dx = m->sdx / scrollease))
+			dx = m->sdx ;
+		if (!(dy = m->sdy / scrollease))
+			dy = m->sdy ;
+		m->sdx -= dx ;
+		m->sdy -= dy ;
+		scrollby(m, dx, dy, m->swarp);
+		busy |= m->sdx || m->sdy ;
+	}
+	if (!busy)
+		settimer(scrolltimer, 0, 0);
+}
+
 void
 scrolldeskvertical(const Arg *arg)
 {
@@ -2029,11 +3785,27 @@ scrolldeskhorizontal(const Arg *arg)
 	scrolldesk(selmon, arg->i, 0, arg->b);
 }
 
+/* Grabs the pointer and hands the drag to "run", "done" gets the event of
+* "type" ending it. Returns zero if the pointer could not be grabbed. */
+int
+startdrag(int type, int cur, void (*done)(XButtonEvent *ev))
+{
+	if( XGrabPointer(dpy, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
+			None, cursor[cur]->cursor, CurrentTime)
+			!= GrabSuccess)
+		return 0 ;
+	drag.type = type ;
+	drag.done = done ;
+	drag.moved = 0 ;
+	return 1 ;
+}
+
+/* Runs "sides" for the screen edges at "x" and "y", the root coordinates of
+* a motion event, so edges cost no pointer query. */
 void
-sidehandle(void)
+sidehandle(int x, int y)
 {
-	int i, x, y, side;
-	if( !getrootptr(&x, &y) ) return;
+	int i, side;
 	side = 0 ;
 	if(x==sw-1)
 		side |= 1<<SideRight ;
@@ -2053,77 +3825,94 @@ sidehandle(void)
 			sides[i].func(&(sides[i].arg));
 }
 
+/* Scrolls the canvas of "m" by moving its viewport. Client positions are
+* kept relative to the canvas, so only clients inside the viewport before or
+* after the scroll are moved. The others stay where they are, off-screen,
+* and are not even looked at: "floating" left on screen only the clients
+* of the viewport, which the canvas index finds. */
 void
 moveWins(Monitor *m, int dx, int dy)
 {
-	Client *c;
-	for ( c=nextclient(m->clients, IsTile) ; c ; c=nextclient(c->next, IsTile) )
-		setFloatingGeometry(c, c->fx + dx, c->fy + dy, c->fw, c->fh);
-	arrange(m);
+	Client *c, **cs;
+	int i, n, x, y;
+
+	n = canvasquery(m, m->wx + m->vx - MAX(dx, 0), m->wy + m->vy - MAX(dy, 0),
+		m->ww + abs(dx), m->wh + abs(dy), &cs);
+	m->vx -= dx ;
+	m->vy -= dy ;
+	for ( i = 0 ; i < n ; i++ ){
+		c = cs[i] ;
+		if( !ckclient(c, IsTile|IsVisible) )
+			continue;
+		x = c->fx - m->vx ;
+		y = c->fy - m->vy ;
+		if( c->isfullscreen
+				|| (!intersects(m, c->x, c->y, WIDTH(c), HEIGHT(c))
+				&& !intersects(m, x, y, WIDTH(c), HEIGHT(c))) )
+			continue;
+		c->x = c->oldx = x ;
+		c->y = c->oldy = y ;
+		XMoveWindow(dpy, c->win, x, y);
+		configure(c);
+	}
+	updatedesktops();
 }
 
 void
-tile(Monitor *m)
+tile(const Layin *in, Plan *out)
 {
-	unsigned int i, n, h, mw, my, ty;
-	Client *c;
-
-	if ( !(n=nClients(m, IsVisible|IsTile)) ) return ;
+	int i, h, mw, my, ty, first, end;
 
-	if (n > m->nmaster){
-		mw = m->nmaster ? m->ww * m->mfact : 0 ;
+	if (in->n > in->nmaster){
+		mw = in->nmaster ? snapsplit(in, in->ww * in->mfact, 1) : 0 ;
 	}else{
-		mw = m->ww ;
-	}
-	for (i = my = ty = 0, c = nextclient(m->clients, IsTile|IsVisible);
-			c;
-			c = nextclient(c->next, IsTile|IsVisible), ++i
-	){
-		if( i < m->nmaster ){
-			h = (m->wh - my) / (MIN(n, m->nmaster) - i) ;
-			resize(c,
-				m->wx, m->wy + my,
-				mw - (2*c->bw), h - (2*c->bw),
-				0
+		mw = in->ww ;
+	}
+	end = pagestack(in, out, &first) + first ;
+	for (i = my = ty = 0; i < in->n; ++i){
+		if( i >= in->nmaster && (i < first || i >= end) ){
+			out->park[i] = 1 ;
+		}else if( i < in->nmaster ){
+			h = (in->wh - my) / (MIN(in->n, in->nmaster) - i) ;
+			planplace(in, out, i,
+				in->wx, in->wy + my,
+				mw - 2*in->bw[i], h - 2*in->bw[i]
 			);
-			my += HEIGHT(c) ;
+			my += out->h[i] + 2*in->bw[i] ;
 		}else{
-			h = (m->wh - ty) / (n - i) ;
-			resize(c,
-				m->wx + mw, m->wy + ty,
-				m->ww - mw - (2*c->bw), h - (2*c->bw),
-				0
+			h = (in->wh - ty) / (end - i) ;
+			planplace(in, out, i,
+				in->wx + mw, in->wy + ty,
+				in->ww - mw - 2*in->bw[i], h - 2*in->bw[i]
 			);
-			ty += HEIGHT(c) ;
+			ty += out->h[i] + 2*in->bw[i] ;
 		}
 	}
 }
 
 void
-rootwin(Monitor *m)
+rootwin(const Layin *in, Plan *out)
 {
 	int i, n, nmaster, colw,
 		rootx, rooty, rootw, rooth,
 		lwinh, rwinh,
-		wx, wy, ww, wh;
+		wx, wy, ww, wh, bw;
 	float mfact;
-	Client *c;
 
-	if ( !(n=nClients(m, IsVisible|IsTile)) ) return ;
-	
-	nmaster = m->nmaster ; mfact = m->mfact ;
-	wx = m->wx ; wy = m->wy ; ww = m->ww ; wh = m->wh ;
+	n = in->n ;
+	nmaster = in->nmaster ; mfact = in->mfact ;
+	wx = in->wx ; wy = in->wy ; ww = in->ww ; wh = in->wh ;
 	rootx = wx ; rooty = wy ; rootw = ww ; rooth = wh ;
 
 	if(n == 1){ /* Just root win. */
-		c = nextclient(m->clients, IsTile|IsVisible) ;
-		resize(c, rootx, rooty, rootw, rooth, 0);
+		planplace(in, out, 0, rootx, rooty, rootw, rooth);
 		return;
 	}
 	--n;
 	/* First it is space that spare windows will take. */	
 	colw = (int)((float)ww * (1-mfact)) ; 
 	rootw -= colw ;
+	lwinh = rwinh = 0 ;
 
 	if(nmaster){
 		if(nmaster < n ){/* Both. */
@@ -2139,59 +3928,51 @@ rootwin(Monitor *m)
 		rwinh = wh/n ;
 	}
 	
-	c = nextclient(m->clients, IsTile|IsVisible) ;
-	resize(c, rootx, rooty, rootw, rooth, 0);
-	
-	for(i = 0, c = nextclient(c->next, IsTile|IsVisible) ;
-			c;
-			c = nextclient(c->next, IsTile|IsVisible), ++i
-	){
+	planplace(in, out, 0, rootx, rooty, rootw, rooth);
+	for(i = 0 ; i < n ; ++i){
+		bw = in->bw[i + 1] ;
 		if(i < nmaster){ /* Left. */
-			resize(c,
-				wx + c->bw, wy + c->bw + (lwinh + c->bw*2)*i,
-				colw - c->bw*2, lwinh - c->bw*2,
-				0
+			planplace(in, out, i + 1,
+				wx + bw, wy + bw + (lwinh + bw*2)*i,
+				colw - bw*2, lwinh - bw*2
 			);
 		} else { /* Right. */
-			resize(c,
-				rootx + rootw + c->bw*2, wy + (rwinh + c->bw*2)*(i-nmaster),
-				colw - c->bw, rwinh - c->bw*2,
-				0
+			planplace(in, out, i + 1,
+				rootx + rootw + bw*2, wy + (rwinh + bw*2)*(i-nmaster),
+				colw - bw, rwinh - bw*2
 			);
 		}
 	}
 }
 
 void
-split(Monitor* m)
+split(const Layin *in, Plan *out)
 {
-	unsigned int i, n, w, mh, mx, tx;
-	Client *c;
+	int i, w, mh, mx, tx, first, end;
 
-	if( !(n=nClients(m, IsVisible|IsTile)) ) return ;
-	
-	if( n> m->nmaster ){
-		mh = m->nmaster ? m->wh * m->mfact : 0 ;
+	if( in->n > in->nmaster ){
+		mh = in->nmaster ? snapsplit(in, in->wh * in->mfact, 0) : 0 ;
 	}else{
-		mh = m->wh ;
-	}
-	for( i=mx=tx=0, c=nextclient(m->clients, IsTile|IsVisible) ; c ; c=nextclient(c->next, IsTile|IsVisible), i++){
-		if( i < m->nmaster ){
-			w = (m->ww - mx) / (MIN(n, m->nmaster) - i) ;
-			resize(c,
-				m->wx + mx, m->wy,
-				w - (2*c->bw),  mh - (2*c->bw),
-				0
+		mh = in->wh ;
+	}
+	end = pagestack(in, out, &first) + first ;
+	for( i=mx=tx=0 ; i < in->n ; i++ ){
+		if( i >= in->nmaster && (i < first || i >= end) ){
+			out->park[i] = 1 ;
+		}else if( i < in->nmaster ){
+			w = (in->ww - mx) / (MIN(in->n, in->nmaster) - i) ;
+			planplace(in, out, i,
+				in->wx + mx, in->wy,
+				w - 2*in->bw[i], mh - 2*in->bw[i]
 			);
-			mx += WIDTH(c) ;
+			mx += out->w[i] + 2*in->bw[i] ;
 		}else{
-			w = (m->ww-tx) / (n-i) ;
-			resize(c,
-				m->wx+tx,  m->wy+mh,
-				w-(2*c->bw), m->wh-mh-(2*c->bw),
-				0
+			w = (in->ww-tx) / (end-i) ;
+			planplace(in, out, i,
+				in->wx+tx, in->wy+mh,
+				w - 2*in->bw[i], in->wh-mh - 2*in->bw[i]
 			);
-			tx += WIDTH(c) ;
+			tx += out->w[i] + 2*in->bw[i] ;
 		}
 	}
 }
@@ -2222,6 +4003,18 @@ togglefree(const Arg *arg)
 	arrange(m);
 }
 
+/* Locks "arg" or, if it is locked already, the layout before it, so one
+* key switches between a latin layout and the native one. */
+void
+togglekeymap(const Arg *arg)
+{
+	Arg a = *arg ;
+
+	if (keymap == arg->v && prevkeymap)
+		a.v = prevkeymap ;
+	setkeymap(&a);
+}
+
 void
 toggletag(const Arg *arg)
 {
@@ -2229,11 +4022,8 @@ toggletag(const Arg *arg)
 
 	if (!selmon->sel) { return; }
 	newtags = selmon->sel->tags ^ (arg->ui & TAGMASK) ;
-	if (newtags) {
-		selmon->sel->tags = newtags;
-		focus(NULL);
-		arrange(selmon);
-	}
+	if (newtags)
+		setclienttags(selmon->sel, newtags);
 }
 
 void
@@ -2267,18 +4057,27 @@ unmanage(Client *c, int destroyed)
 	Monitor *m = c->mon;
 	XWindowChanges wc;
 
+	if (drag.c == c)
+		drag.c = NULL ;
+	/* A later client may reuse the address of "c", on any monitor. */
+	for (m = mons; m; m = m->next)
+		dropplans(m);
+	m = c->mon ;
+	if (c->syncalarm)
+		XSyncDestroyAlarm(dpy, c->syncalarm);
+	c->syncdeferred = 0 ;
+	syncdone(c);
 	detach(c);
 	detachstack(c);
 	if (!destroyed) {
 		wc.border_width = c->oldbw ;
-		XGrabServer(dpy); /* Avoid race conditions. */
-		XSetErrorHandler(xerrordummy);
+		/* The window may be gone already. */
+		ignorestart();
 		XConfigureWindow(dpy, c->win, CWBorderWidth, &wc); /* restore border */
 		XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
 		setclientstate(c, WithdrawnState);
-		XSync(dpy, False);
-		XSetErrorHandler(xerror);
-		XUngrabServer(dpy);
+		XDeleteProperty(dpy, c->win, netatom[NetWMDesktop]);
+		ignoreend();
 	}
 	free(c);
 	focus(NULL);
@@ -2336,18 +4135,18 @@ updatebarpos(Monitor *m)
 	}
 }
 
+/* Desktops are tags: published once per round of "run", like the client lists. */
 void
-updateclientlist(void)
+updatedesktops(void)
 {
-	Client *c;
-	Monitor *m;
+	desktopsdirty = 1 ;
+}
 
-	XDeleteProperty(dpy, root, netatom[NetClientList]);
-	for (m = mons; m; m = m->next)
-		for (c = m->clients; c; c = c->next)
-			XChangeProperty(dpy, root, netatom[NetClientList],
-				XA_WINDOW, 32, PropModeAppend,
-				(unsigned char *) &(c->win), 1);
+/* The client lists are only marked here and published once per round of "run". */
+void
+updateclientlist(void)
+{
+	clientlistdirty = 1 ;
 }
 
 int
@@ -2398,6 +4197,7 @@ updategeom(void)
 				while ((c = m->clients)) {
 					dirty = 1;
 					m->clients = c->next;
+					canvasdel(c);
 					detachstack(c);
 					c->mon = mons;
 					attach(c);
@@ -2432,25 +4232,89 @@ void
 updatenumlockmask(void)
 {
 	unsigned int i, j;
+	KeyCode numlock;
 	XModifierKeymap *modmap;
 
 	numlockmask = 0;
+	numlock = XKeysymToKeycode(dpy, XK_Num_Lock);
 	modmap = XGetModifierMapping(dpy) ;
 	for (i = 0; i < 8; i++){
 		for (j = 0; j < modmap->max_keypermod; j++)
 			if (modmap->modifiermap[i * modmap->max_keypermod + j]
-					== XKeysymToKeycode(dpy, XK_Num_Lock)){
+					== numlock){
 				numlockmask = (1 << i) ;
 			}
 	}
 	XFreeModifiermap(modmap);
 }
 
+void
+updateprotocols(Client *c)
+{
+	Atom *protocols;
+	int n, i;
+
+	c->protocols = 0 ;
+	if (!XGetWMProtocols(dpy, c->win, &protocols, &n)) {
+		updatesynccounter(c);
+		return;
+	}
+	while (n--)
+		for (i = 0; i < WMLast; i++)
+			if (protocols[n] == wmatom[i])
+				c->protocols |= 1 << i;
+	XFree(protocols);
+	updatesynccounter(c);
+}
+
+/* Follows the counter of _NET_WM_SYNC_REQUEST with an alarm, so "run" learns
+* when the client has drawn the size asked for. */
+void
+updatesynccounter(Client *c)
+{
+	int di;
+	unsigned long dl;
+	unsigned char *p = NULL;
+	Atom da;
+	XSyncCounter counter = None;
+	XSyncAlarmAttributes aa;
+
+	if (syncevbase >= 0 && c->protocols & 1 << WMSyncRequest
+			&& XGetWindowProperty(dpy, c->win, netatom[NetWMSyncRequestCounter],
+				0L, 1L, False, XA_CARDINAL, &da, &di, &dl, &dl, &p) == Success && p) {
+		counter = *(unsigned long *)p;
+		XFree(p);
+	}
+	if (counter == c->synccounter)
+		return;
+	if (c->syncalarm) {
+		XSyncDestroyAlarm(dpy, c->syncalarm);
+		c->syncalarm = None ;
+	}
+	c->synccounter = counter ;
+	if (!counter || !XSyncQueryCounter(dpy, counter, &c->syncvalue)) {
+		c->synccounter = None ;
+		syncdone(c);
+		return;
+	}
+	aa.trigger.counter = counter ;
+	aa.trigger.value_type = XSyncAbsolute ;
+	aa.trigger.wait_value = c->syncvalue ;
+	aa.trigger.test_type = XSyncPositiveComparison ;
+	XSyncIntToValue(&aa.delta, 0);
+	aa.events = True ;
+	c->syncalarm = XSyncCreateAlarm(dpy, XSyncCACounter|XSyncCAValueType|XSyncCAValue
+		|XSyncCATestType|XSyncCADelta|XSyncCAEvents, &aa);
+}
+
 void
 updatesizehints(Client *c)
 {
 	long msize;
 	XSizeHints size;
+	uint basew = c->basew, baseh = c->baseh, incw = c->incw, inch = c->inch ;
+	uint minw = c->minw, minh = c->minh, maxw = c->maxw, maxh = c->maxh ;
+	float mina = c->mina, maxa = c->maxa ;
 
 	if(!XGetWMNormalHints(dpy, c->win, &size, &msize)){
 		/* Size is uninitialized, ensure that size.flags aren't used. */
@@ -2493,6 +4357,12 @@ updatesizehints(Client *c)
 		c->maxa = c->mina = 0.0 ;
 	}
 	c->isfixed = (c->maxw && c->maxh && c->maxw == c->minw && c->maxh == c->minh) ;
+	if (c->mon && (c->basew != basew || c->baseh != baseh
+			|| c->incw != incw || c->inch != inch
+			|| c->minw != minw || c->minh != minh
+			|| c->maxw != maxw || c->maxh != maxh
+			|| c->mina != mina || c->maxa != maxa))
+		dropplans(c->mon);
 }
 
 void
@@ -2507,6 +4377,7 @@ updatestatus(void)
 void
 updatetitle(Client *c)
 {
+	c->titledirty = 0 ;
 	if (!gettextprop(c->win, netatom[NetWMName], c->name, sizeof c->name)){
 		gettextprop(c->win, XA_WM_NAME, c->name, sizeof c->name);
 	}
@@ -2518,13 +4389,10 @@ updatetitle(Client *c)
 void
 updatewindowtype(Client *c)
 {
-	Atom state = getatomprop(c, netatom[NetWMState]);
-	Atom wtype = getatomprop(c, netatom[NetWMWindowType]);
-
-	if (state == netatom[NetWMFullscreen]){
+	if (getatomprop(c, netatom[NetWMState]) == netatom[NetWMFullscreen]){
 		setfullscreen(c, 1);
 	}
-	if( wtype == netatom[NetWMWindowTypeDialog] ){
+	if( c->wtype == netatom[NetWMWindowTypeDialog] ){
 		c->isfree = 1 ;
 	}
 }
@@ -2546,7 +4414,11 @@ updatewmhints(Client *c)
 		}else{
 			c->neverfocus = 0;
 		}
+		c->wmh = *wmh ;
+		c->haswmh = 1 ;
 		XFree(wmh);
+	}else{
+		c->haswmh = 0 ;
 	}
 }
 void
@@ -2560,7 +4432,7 @@ setupview(int nview)
 }
 
 int
-bitid(unsigned int bits)
+bitid(uint bits)
 {
 	if(!bits)
 		return -1 ;
@@ -2636,39 +4508,17 @@ wintomon(Window w)
 	return selmon ;
 }
 
-int
-waitmouse(XEvent *ev, int type)
-{
-
-	if( XGrabPointer(dpy, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
-			None, cursor[CurMove]->cursor, CurrentTime)
-			!= GrabSuccess)
-		return 1 ;
-		
-	do{
-		XMaskEvent(dpy, MOUSEMASK|ExposureMask|SubstructureRedirectMask, ev);
-		switch( ev->type ){
-		case ConfigureRequest :
-		case Expose :
-		case MapRequest :
-			handler[ev->type](ev);
-		case MotionNotify:
-			sidehandle();
-		break;
-		}
-	}while( ev->type != type );
-
-	XUngrabPointer(dpy, CurrentTime) ;
-
-	return 0 ;
-}
-
 /* There's no way to check accesses to destroyed windows, thus those cases are
 * ignored (especially on UnmapNotify's). Other types of errors call Xlibs
 * default error handler, which may call exit. */
 int
 xerror(Display *dpy, XErrorEvent *ee)
 {
+	int i;
+
+	for (i = 0; i < nignores; i++)
+		if (ignores[i].first <= ee->serial && ee->serial <= ignores[i].last)
+			return 0;
 	if( ee->error_code == BadWindow
 			|| (ee->request_code == X_SetInputFocus && ee->error_code == BadMatch)
 			|| (ee->request_code == X_PolyText8 && ee->error_code == BadDrawable)
@@ -2685,12 +4535,6 @@ xerror(Display *dpy, XErrorEvent *ee)
 	return xerrorxlib(dpy, ee); /* May call exit. */
 }
 
-int
-xerrordummy(Display *dpy, XErrorEvent *ee)
-{
-	return 0;
-}
-
 /* Startup Error handler to check if another window manager
 * is already running. */
 int
@@ -2700,6 +4544,211 @@ xerrorstart(Display *dpy, XErrorEvent *ee)
 	return -1;
 }
 
+#ifdef XINPUT2
+/* Selects smooth scrolling on root. XI2 motion selected there hides core
+* motion from root, so "xievent" hands motion on to "motionnotify". */
+void
+setupxi(void)
+{
+	unsigned char mask[XIMaskLen(XI_LASTEVENT)] = {0};
+	XIEventMask em = { XIAllDevices, sizeof mask, mask } ;
+	int di, major = 2, minor = 3;
+
+	if (!XQueryExtension(dpy, "XInputExtension", &xiopcode, &di, &di)
+			|| XIQueryVersion(dpy, &major, &minor) != Success
+			|| major < 2 || (major == 2 && minor < 1)) {
+		xiopcode = -1 ;
+		return;
+	}
+	barriers = major > 2 || minor >= 3 ;
+	major = 5 ;
+	minor = 0 ;
+	barriers = barriers && XFixesQueryExtension(dpy, &di, &di)
+		&& XFixesQueryVersion(dpy, &major, &minor) && major >= 5 ;
+	XISetMask(mask, XI_HierarchyChanged);
+	XISetMask(mask, XI_DeviceChanged);
+	XISelectEvents(dpy, root, &em, 1);
+	memset(mask, 0, sizeof mask);
+	em.deviceid = XIAllMasterDevices ;
+	XISetMask(mask, XI_Motion);
+	if (barriers)
+		XISetMask(mask, XI_BarrierHit);
+	XISelectEvents(dpy, root, &em, 1);
+	updatescrollaxes();
+	updatebarriers();
+}
+
+/* Puts a pointer barrier on every edge of the screen. Pushing against one
+* runs "sidehandle" without a grab and without motion events, which the
+* windows under the pointer may take. */
+void
+updatebarriers(void)
+{
+	int i;
+
+	if (!barriers)
+		return;
+	for (i = 0; i < LENGTH(edges); i++)
+		if (edges[i])
+			XFixesDestroyPointerBarrier(dpy, edges[i]);
+	edges[0] = XFixesCreatePointerBarrier(dpy, root, 0, 0, 0, sh, BarrierPositiveX, 0, NULL);
+	edges[1] = XFixesCreatePointerBarrier(dpy, root, sw, 0, sw, sh, BarrierNegativeX, 0, NULL);
+	edges[2] = XFixesCreatePointerBarrier(dpy, root, 0, 0, sw, 0, BarrierPositiveY, 0, NULL);
+	edges[3] = XFixesCreatePointerBarrier(dpy, root, 0, sh, sw, sh, BarrierNegativeY, 0, NULL);
+}
+
+/* Reads the scroll valuators of all slave pointers again. */
+void
+updatescrollaxes(void)
+{
+	XIDeviceInfo *info;
+	XIScrollClassInfo *sc;
+	Scrollaxis *a;
+	int i, j, n;
+
+	nscrollaxes = 0 ;
+	if (!(info = XIQueryDevice(dpy, XIAllDevices, &n)))
+		return;
+	for (i = 0; i < n; i++) {
+		if (info[i].use != XISlavePointer)
+			continue;
+		for (j = 0; j < info[i].num_classes && nscrollaxes < LENGTH(scrollaxes); j++) {
+			sc = (XIScrollClassInfo *)info[i].classes[j];
+			if (sc->type != XIScrollClass || sc->increment == 0)
+				continue;
+			a = &scrollaxes[nscrollaxes++];
+			memset(a, 0, sizeof *a);
+			a->deviceid = info[i].deviceid ;
+			a->number = sc->number ;
+			a->vertical = sc->scroll_type == XIScrollTypeVertical ;
+			a->increment = sc->increment ;
+		}
+	}
+	XIFreeDeviceInfo(info);
+}
+
+void
+xievent(XEvent *e)
+{
+	XGenericEventCookie *cookie = &e->xcookie ;
+	XIDeviceEvent *ev = cookie->data ;
+	XIBarrierEvent *be;
+	XEvent me = {0};
+
+	if (cookie->extension != xiopcode || !ev)
+		return;
+	switch (cookie->evtype) {
+	case XI_HierarchyChanged:
+	case XI_DeviceChanged:
+		updatescrollaxes();
+		break;
+	case XI_Motion:
+		xiscroll(ev);
+		me.xmotion.type = MotionNotify ;
+		me.xmotion.window = ev->event ;
+		me.xmotion.root = ev->root ;
+		me.xmotion.subwindow = ev->child ;
+		me.xmotion.time = ev->time ;
+		me.xmotion.x = ev->event_x ;
+		me.xmotion.y = ev->event_y ;
+		me.xmotion.x_root = ev->root_x ;
+		me.xmotion.y_root = ev->root_y ;
+		me.xmotion.state = ev->mods.effective ;
+		me.xmotion.same_screen = True ;
+		motionnotify(&me);
+		break;
+	case XI_BarrierHit:
+		/* Once per push, a drag has it from its motion. */
+		be = cookie->data ;
+		if (drag.type || be->eventid == edgeevent)
+			break;
+		edgeevent = be->eventid ;
+		sidehandle(MIN(MAX((int)be->root_x, 0), sw - 1),
+			MIN(MAX((int)be->root_y, 0), sh - 1));
+		break;
+	}
+	XFreeEventData(dpy, cookie);
+}
+
+/* Scrolls by the scroll valuators of the event through the Button4 to
+* Button7 bindings of the scrolling functions, one increment of a valuator
+* being one click. The clicks the server emulates for a motion scrolled by
+* here are dropped by "buttonpress". A valuator idle for XISCROLLGAP starts
+* over, since motion over clients selecting it never got here, and its
+* first click goes the emulated way. */
+void
+xiscroll(XIDeviceEvent *ev)
+{
+	const Button *b;
+	Scrollaxis *a;
+	Arg arg;
+	double *v = ev->valuators.values, d, px;
+	uint i, j, click, button;
+
+	click = wintoclient(ev->child) ? ClkClientWin : ClkRootWin ;
+	for (i = 0; i < ev->valuators.mask_len * 8; i++) {
+		if (!XIMaskIsSet(ev->valuators.mask, i))
+			continue;
+		d = *v++;
+		for (a = scrollaxes; a < scrollaxes + nscrollaxes; a++)
+			if (a->deviceid == ev->sourceid && a->number == i)
+				break;
+		if (a == scrollaxes + nscrollaxes)
+			continue;
+		if (!a->time || ev->time - a->time > XISCROLLGAP) {
+			a->last = d ;
+			a->rest = 0 ;
+			a->time = ev->time ;
+			continue;
+		}
+		a->time = ev->time ;
+		d = (d - a->last) / a->increment ;
+		a->last += d * a->increment ;
+		if (d == 0)
+			continue;
+		button = a->vertical ? (d > 0 ? Button5 : Button4) : (d > 0 ? 7 : 6) ;
+		for (j = clkbuttonsoff[click]; j < clkbuttonsoff[click + 1]; j++) {
+			b = clkbuttons[j];
+			if (b->button != button || !ISSCROLL(b->func)
+					|| CLEANMASK(b->mask) != CLEANMASK(ev->mods.effective))
+				continue;
+			px = b->arg.i * (d > 0 ? d : -d);
+			/* Left over pixels of the other direction are dropped. */
+			if ((a->rest < 0) != (px < 0))
+				a->rest = 0 ;
+			a->rest += px ;
+			arg = b->arg ;
+			arg.i = a->rest ;
+			a->rest -= arg.i ;
+			xiscrolled = nowms();
+			if (arg.i)
+				b->func(&arg);
+		}
+	}
+}
+#endif /* XINPUT2 */
+
+/* Follows group changes made by other clients or by XKB actions, which
+* do not go through "setkeymap". */
+void
+xkbnotify(XEvent *e)
+{
+	XkbEvent *ev = (XkbEvent *)e;
+	int i;
+
+	if (ev->any.xkb_type != XkbStateNotify
+			|| (keymap && ev->state.locked_group == keymap->group))
+		return;
+	for (i = 0; i < LENGTH(keymaps); i++)
+		if (keymaps[i].group == ev->state.locked_group) {
+			if (keymap)
+				prevkeymap = keymap ;
+			keymap = &keymaps[i] ;
+			setstatus(keymap->name);
+			return;
+		}
+}
+
 void
 zoom(const Arg *arg)
 {
@@ -2742,7 +4791,11 @@ main(int argc, char *argv[])
 	Arg rcarg = {.v = rccmd} ;
 	spawn(&rcarg);
 	run();
-	if(restart) execvp(argv0, argv) ;
+	if(restart){
+		printcounters();
+		sigprocmask(SIG_SETMASK, &origmask, NULL);
+		execvp(argv0, argv);
+	}
 	cleanup();
 	XCloseDisplay(dpy);
 	return EXIT_SUCCESS ;
@@ -0,0 +1,173 @@
+/* See LICENSE file for copyright and license details.
+*
+* Measures keypress handling time of the running WM under a sustained
+* PropertyNotify storm. A child process maps a window on its own
+* connection and changes its WM_NAME at a fixed rate. Meanwhile XTest
+* presses MODKEY+a and MODKEY+Tab in turn, bound to "setkeymap", which
+* names the layout in the root WM_NAME. The time from the fake press
+* to that PropertyNotify is the latency of the keypress behind the storm.
+* Run it on an empty tag, it leaves the dvorak layout locked. */
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+
+#include "util.h"
+
+#define LENGTH(X) (sizeof X / sizeof X[0])
+#define TRIALS 50
+#define TICK 10 /* Milliseconds between bursts of the storm. */
+#define TIMEOUT 10000 /* Milliseconds to wait for the WM. */
+
+static const int rates[] = { 0, 1000, 10000, 100000 } ; /* WM_NAME changes per second. */
+static const struct { KeySym key; const char *status; } presses[] = {
+	{ XK_a, "qwerty" },
+	{ XK_Tab, "dvorak" },
+} ;
+
+static Display *dpy;
+static Window root;
+
+static double
+nowus(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int
+cmp(const void *a, const void *b)
+{
+	double d = *(const double *)a - *(const double *)b;
+
+	return (d > 0) - (d < 0);
+}
+
+/* Changes WM_NAME of its own window "rate" times a second until killed. */
+static void
+storm(int rate)
+{
+	Display *sdpy;
+	Window w;
+	struct timespec next;
+	char name[32];
+	long n = 0;
+	int i;
+
+	if (!(sdpy = XOpenDisplay(NULL)))
+		die("propstorm: cannot open display");
+	w = XCreateSimpleWindow(sdpy, DefaultRootWindow(sdpy), 0, 0, 100, 100, 0, 0, 0);
+	XStoreName(sdpy, w, "propstorm");
+	XMapWindow(sdpy, w);
+	XFlush(sdpy);
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (;;) {
+		for (i = 0; i < rate * TICK / 1000; i++) {
+			snprintf(name, sizeof name, "storm %ld", n++);
+			XStoreName(sdpy, w, name);
+		}
+		XFlush(sdpy);
+		next.tv_nsec += TICK * 1000000L;
+		if (next.tv_nsec >= 1000000000L) {
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000L;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+}
+
+/* Waits for the WM to name "status" in the root WM_NAME, returns the time it did. */
+static double
+waitstatus(const char *status)
+{
+	XEvent ev;
+	XTextProperty p;
+	struct pollfd pfd = { .fd = ConnectionNumber(dpy), .events = POLLIN } ;
+	double start = nowus();
+	int match;
+
+	for (;;) {
+		while (XPending(dpy)) {
+			XNextEvent(dpy, &ev);
+			if (ev.type != PropertyNotify || ev.xproperty.atom != XA_WM_NAME)
+				continue;
+			match = 0 ;
+			if (XGetWMName(dpy, root, &p) && p.value) {
+				match = !strcmp((char *)p.value, status);
+				XFree(p.value);
+			}
+			if (match)
+				return nowus();
+		}
+		if (nowus() - start > TIMEOUT * 1e3)
+			die("propstorm: status '%s' was not set", status);
+		poll(&pfd, 1, 100);
+	}
+}
+
+static void
+press(KeyCode mod, KeyCode key)
+{
+	XTestFakeKeyEvent(dpy, mod, True, CurrentTime);
+	XTestFakeKeyEvent(dpy, key, True, CurrentTime);
+	XTestFakeKeyEvent(dpy, key, False, CurrentTime);
+	XTestFakeKeyEvent(dpy, mod, False, CurrentTime);
+	XFlush(dpy);
+}
+
+int
+main(void)
+{
+	KeyCode mod, keys[LENGTH(presses)];
+	double t0, lat[TRIALS];
+	int i, j, k, di;
+	pid_t pid;
+
+	if (!(dpy = XOpenDisplay(NULL)))
+		die("propstorm: cannot open display");
+	if (!XTestQueryExtension(dpy, &di, &di, &di, &di))
+		die("propstorm: no XTest extension");
+	root = DefaultRootWindow(dpy);
+	XSelectInput(dpy, root, PropertyChangeMask);
+	mod = XKeysymToKeycode(dpy, XK_Super_L);
+	for (i = 0; i < LENGTH(presses); i++)
+		keys[i] = XKeysymToKeycode(dpy, presses[i].key);
+
+	printf("%8s %10s %10s %10s\n", "rate", "median_us", "p90_us", "max_us");
+	for (i = 0, k = 0; i < LENGTH(rates); i++) {
+		if ((pid = fork()) < 0)
+			die("fork:");
+		if (!pid) {
+			close(ConnectionNumber(dpy));
+			storm(rates[i]);
+		}
+		/* Let the WM manage the storm window and reach a steady rate. */
+		usleep(500000);
+		for (j = 0; j < TRIALS; j++, k = (k + 1) % LENGTH(presses)) {
+			t0 = nowus();
+			press(mod, keys[k]);
+			lat[j] = waitstatus(presses[k].status) - t0;
+			usleep(20000);
+		}
+		kill(pid, SIGTERM);
+		waitpid(pid, NULL, 0);
+		qsort(lat, TRIALS, sizeof *lat, cmp);
+		printf("%8d %10.0f %10.0f %10.0f\n", rates[i],
+			lat[TRIALS / 2], lat[TRIALS * 9 / 10], lat[TRIALS - 1]);
+	}
+	if (k)
+		press(mod, keys[LENGTH(presses) - 1]);
+	XCloseDisplay(dpy);
+	return EXIT_SUCCESS;
+}